@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +7,17 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <limits.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "mmutrace.h"
 
 struct list {
 	struct node* head;
@@ -19,10 +31,15 @@ struct node {
 };
 
 struct vma_t {
-	unsigned int start_vpage : 6;
-	unsigned int end_vpage : 6;
+	unsigned long start_vpage;
+	unsigned long end_vpage;
 	unsigned int write_protect : 1;
 	unsigned int filemapped : 1;
+	unsigned int huge : 2; // huge page size class backing the vma, 0 for base pages
+	unsigned int shared : 1; // maps object obj, every process mapping it sees the same pages
+	unsigned int cow : 1; // maps object obj copy-on-write, pages are shared until written
+	unsigned int obj; // shared object id, 0 for a private vma
+	unsigned int id; // position in the process's vma_list
 };
 
 struct pte_t {
@@ -32,13 +49,52 @@ struct pte_t {
 	unsigned int referenced : 1;
 	unsigned int pagedout : 1;
 	unsigned int filemapped : 1;
-	unsigned int frame : 7;
+	unsigned int huge : 2; // size class of the huge mapping this page is part of, 0 if none
+	unsigned int prefetched : 1; // mapped by readahead and not referenced yet
+	unsigned int shared : 1; // maps a page of a shared or COW object, possibly along with other ptes
+	unsigned int cowed : 1; // COW page this process has written, it owns a private copy
+	unsigned int frame;
 };
 
 struct frame_t {
 	unsigned int fid;
 	unsigned int pid;
-	unsigned int vpage;
+	unsigned long vpage;
+	struct pte_t* pte; // pte currently mapping this frame
+	int lru_prev; // recency list links for the LRU pager, -1 terminated
+	int lru_next;
+	int mapcount; // ptes mapping the frame, more than 1 only for a shared page
+	int rmap; // mappings besides pid/vpage/pte, see struct rmap_t
+	int objpage; // object page held by the frame, -1 for a private page
+	int node; // memory node the frame is on, 0 without -N
+};
+
+/*
+	Memory node (-N). Each node owns a contiguous range of the frametable
+	and its own slice of the kswapd freeList, and keeps the hands the
+	frame-indexed pagers use when they choose a victim on it alone.
+*/
+struct numa_node {
+	int lo; // frames lo..hi-1
+	int hi;
+	int next; // next never-used frame
+	int freeCount; // frames on freeList[lo..lo+freeCount-1]
+	int frameInd; // the node's fifo, second chance and working set hand
+	int clockHand; // the node's clock and WSClock hand
+};
+
+// one more mapping of a shared frame, chained from frame_t.rmap
+struct rmap_t {
+	unsigned int pid;
+	unsigned long vpage;
+	struct pte_t* pte;
+	int next; // next mapping of the same frame, or in the free pool, -1 terminated
+};
+
+// page of a shared or COW object, indexed through the sim's objects pagemap
+struct objpage {
+	int frame; // frame holding the page, -1 if not resident
+	bool pagedout; // anonymous page written to swap
 };
 
 struct pstat_t {
@@ -53,67 +109,557 @@ struct pstat_t {
 	unsigned long segprot;
 };
 
+#define GEN_PATTERNS 8
+#define GEN_SLOTS 8
+
+/*
+	Input trace. Regular files are mmapped and scanned in place; pipes and
+	stdin ("-") fall back to a line-at-a-time stream. Either backing may hold
+	a text trace or the packed binary format from mmutrace.h.
+*/
+struct trace {
+	FILE* fp;
+	char* buf; // mmapped file, NULL when streaming
+	size_t len;
+	bool binary;
+	const char* cur;
+	const char* end;
+	struct layout* layout; // from the header, see createProcArray
+	struct generator* gen; // synthetic source (-g), NULL for a file
+};
+
+// xoshiro256** state
+struct rng {
+	unsigned long s[4];
+};
+
+/*
+	Synthetic trace (-g). A producer thread generates instructions into a ring
+	of GEN_SLOTS chunks and read_instructions drains it, so generation
+	overlaps with the simulation and a run of any length needs no trace file.
+*/
+struct generator {
+	char patterns[GEN_PATTERNS]; // cycled through every phase references, see gen_page
+	int patternCount;
+	unsigned long count; // instructions to generate, context switches included
+	unsigned long made;
+	int procs;
+	unsigned long pages; // per process, one vma from 0
+	double writes; // fraction of references that write
+	double theta; // Zipf skew
+	unsigned long loop; // pages cycled by the loop pattern
+	unsigned long phase;
+	unsigned long switchEvery; // mean references between context switches
+	int current; // process making references, -1 before the first switch
+	unsigned long* cursors; // per process position of the scan and loop patterns
+	double zetan, zeta2, alpha, eta; // Zipf constants, see gen_zipf
+	struct rng rng;
+	struct inst* ring; // GEN_SLOTS chunks of INST_CHUNK
+	size_t lens[GEN_SLOTS]; // instructions in each full slot, 0 marks the end
+	int head; // slot read_instructions takes next
+	int tail; // slot the producer fills next
+	int full; // slots filled and not yet drained
+	size_t offset; // instructions already taken from the head slot
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+	pthread_t thread;
+};
+
+// one decoded trace operation
+struct inst {
+	unsigned long vpage; // pid for 'c'
+	char op;
+};
+
 struct process {
 	unsigned int pid;
-	struct pte_t* pagetable;
+	void* pagetable; // radix page table root, see lookup_pte
+	struct pte_t* ptLeaf; // last leaf lookup_pte walked to, and the vpage >> PT_BITS it covers
+	unsigned long ptLeafTag;
 	struct list* vma_list;
+	struct vma_t** vmatable; // vpage-indexed view of vma_list for O(1) fault-time lookup, small address spaces only
+	struct vma_t** vmasorted; // vma_list sorted by start_vpage, an implicit interval tree when there is no vmatable
+	unsigned long* vmaMaxEnd; // largest end_vpage under each vmasorted position, see vma_tree_build
+	unsigned int* vmaMinId; // smallest vma id under each position
+	unsigned int hugeClasses; // bit h set if some vma uses huge size class h
+	unsigned long vtime; // virtual time: references made by this process so far
+	struct readahead* ra; // per vma readahead state, NULL without -R
+	int home; // memory node the process runs on, pid % nodes
+	const struct layout* layout; // trace the process comes from
 	struct pstat_t* pstat;
-	unsigned int* ages;
+};
+
+/*
+	Processes and address space of one trace, as its header describes them.
+	Built once per trace and shared read-only by every sim that replays it.
+*/
+struct layout {
+	int procCount;
+	struct process* procs; // pids and vmas; page tables and stats are per sim
+	unsigned long numVpages; // sized from the vmas in the header
+	int ptLevels;
+	bool hugeEnabled; // some vma is huge page backed
+	bool sharing; // some vma is shared or COW
+	size_t* nextUse; // position of the next reference to the same page, for OPT
+	unsigned long fingerprint; // of the trace, see traceFingerprint; only set for checkpointed runs
+};
+
+// readahead window of one vma, see readahead
+struct readahead {
+	unsigned long after; // vpage after the last major fault, 0 if there was none
+	unsigned long next; // first vpage past the window, where a sequential stream faults next
+	unsigned long size; // pages in the window, 0 when access looks random
+};
+
+// open-addressing map from (pid, vpage) to a dense page index, for per-page state outside the page tables
+struct pagemap {
+	unsigned long* keys;
+	int* vals;
+	size_t cap;
+	size_t count;
+};
+
+/*
+	Pool of page entries for the pagers that remember evicted pages (ghosts)
+	as well as resident ones. Entries are found by (pid, vpage) through a
+	chained hash and sit on at most one of a few doubly linked lists, all
+	threaded through pool indices.
+*/
+struct history {
+	unsigned long* keys; // page_key()
+	int* frames; // frame holding the page, -1 for a ghost
+	int* prev; // list links, -1 terminated
+	int* next;
+	int* chain; // next entry in the same hash bucket, or in the free pool
+	unsigned char* lists; // list the entry is on, HIST_NONE if none
+	unsigned char* flags; // HIST_FRESH, HIST_HOT, HIST_TEST
+	int* buckets;
+	size_t mask;
+	int freeHead;
+	int head[4]; // per list, head is the oldest entry
+	int tail[4];
+	int size[4];
+};
+
+/*
+	Set-associative TLB. Entry i of set s lives at s * ways + i in each array;
+	keys carry the pid as well as the vpage so a shootdown never hits another
+	process's entry, whether or not ASIDs keep entries across switches.
+*/
+struct tlb {
+	int sets;
+	int ways;
+	unsigned long* keys; // tlb_key(), 0 for an invalid entry
+	struct pte_t** ptes; // cached translation
+	unsigned long* stamps; // last use (lru) or fill time (fifo)
+	unsigned long clock;
+	unsigned long seed; // private xorshift state for random replacement, so randVals are not consumed
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long flushes;
+	unsigned long shootdowns;
+};
+
+/*
+	State of one simulation run. Everything a run mutates lives here so that
+	several runs can replay the same decoded trace, or different traces, on
+	separate threads; the trace's layout and the random array are read-only.
+*/
+struct sim {
+	const struct layout* layout;
+	char pager;
+	int num_frames;
+	struct process* procArray;
+	struct process* current;
+	struct frame_t* frametable;
+	int freeFrame; // count of free frames...max is num_frames, then paging starts
+	int* freeList; // frames kswapd has reclaimed, a stack per memory node, NULL without -d
+	int freeCount; // over all nodes
+	int frameLimit; // frames the sim may hold at once, below num_frames only under -L pff
+	unsigned long pffRefs; // references and faults up to the last -L pff rebalance
+	unsigned long pffFaults;
+	struct numa_node* numa; // NUMA_NODES memory nodes, one without -N
+	int victimLo; // frames victim selection may take, a node's range during a node-local choice
+	int victimHi;
+	unsigned long localRefs; // references to a frame on the process's home node, counted with -N
+	unsigned long remoteRefs;
+	unsigned long fallbacks; // pages placed on another node because theirs had no free frame
+	unsigned long* freebits; // frames on freeList, which pagers pass over
+	int frameInd; // index into the frametable...incrememnted when you choose victim frame
+	bool pagerOn;
+	unsigned long instCount;
+	unsigned long ctxSwitches;
+	unsigned long cost;
+	int ofs; // next randVals entry
+	struct rng rng; // replaces randVals under -s
+	int requests; // number of paging requests (select_victim frame calls)
+	int clockHand; // next frame the clock hand looks at
+	int lruHead; // most recently used frame
+	int lruTail; // least recently used frame, the LRU victim
+	int* optHeap; // max-heap of resident frames keyed by next use, for OPT
+	int* optHeapPos; // index of each frame in optHeap, -1 if absent
+	size_t* optKey; // next reference position of the page in each frame
+	int optHeapSize;
+	unsigned long* refbits; // per-frame copy of the resident page's R bit
+	unsigned long* modbits; // per-frame copy of the resident page's M bit
+	unsigned int* ages; // per-frame aging counters
+	unsigned long* lastUse; // per-frame virtual time of the owner when the page was last seen referenced, for w/W
+	struct history* hist; // resident and ghost pages for ARC, CAR and CLOCK-Pro
+	int* frameEntry; // history entry of the page in each frame
+	int faultEntry; // ghost entry of the page being faulted in, -1 if it has none
+	int target; // adapted: T1 size for ARC and CAR, resident cold pages for CLOCK-Pro
+	bool arcDiscard; // ARC: the fault drops the T1 LRU page without keeping a ghost
+	int handHot; // CLOCK-Pro hands, history entries
+	int handCold;
+	int handTest;
+	int countHot; // resident hot and cold pages and ghosts on the CLOCK-Pro clock
+	int countCold;
+	int countTest;
+	unsigned long ghostHits;
+	struct tlb* tlb; // NULL without -t
+	unsigned long faults;
+	unsigned long hugeMaps; // huge ranges mapped at fault time or by collapse
+	unsigned long splits;
+	unsigned long collapses;
+	int popPid; // huge range being populated, -1 if none; reclaiming one of its pages aborts it
+	unsigned long popBase;
+	unsigned long popSize;
+	bool popAborted;
+	bool reclaiming; // kswapd is choosing victims, not a fault
+	unsigned long kswapdWakeups;
+	unsigned long directReclaims; // faults that found no free frame and reclaimed one themselves
+	struct pstat_t kswapdStat; // unmaps and writebacks done in the background
+	unsigned long raPages; // pages mapped by readahead
+	unsigned long raHits; // of those, referenced before they were evicted
+	unsigned long raWasted; // evicted without a reference
+	struct rmap_t* rmap; // pool of shared frame mappings, grown as needed
+	int rmapCap;
+	int rmapFree;
+	struct pagemap* objects; // (object, offset in the vma) to objPages index, NULL without shared vmas
+	struct objpage* objPages;
+	int objCount;
+	int objCap;
+	int faultObj; // object page the fault in flight maps, -1 for a private page
+	unsigned long shareMaps; // faults satisfied by mapping a resident shared page
+	unsigned long cowCopies;
+	unsigned long cowReuses; // COW writes by the last mapping, which keeps the frame
+	unsigned long sharedPtes; // extra mappings of shared frames, frames a private copy of each would take
+	unsigned long sharedPeak;
+	unsigned long nextSnap; // instruction count of the next -i snapshot
+	struct pstat_t* snapBase; // per process pstats at the last snapshot, NULL without -i
+	pid_t ckptWriter; // child still writing the last checkpoint, 0 if none
+	struct outbuf* out;
+	struct outbuf* log; // binary event log (-l), NULL when events are printed as text
+};
+
+// output kept in a user-space buffer and written out a chunk at a time
+struct outbuf {
+	int fd; // -1 discards everything
+	bool owned; // fd is closed with the buffer
+	char* buf;
+	size_t len;
+	size_t cap;
+};
+
+// direction and file of serializeSim
+struct ckpt {
+	FILE* fp;
+	bool load;
+};
+
+// traces waiting to be run by the threads in runBatch
+struct batch {
+	char** traces;
+	int count;
+	int next;
+	pthread_mutex_t lock;
+};
+
+// sims waiting to be run by the threads in runSims
+struct pool {
+	struct sim** sims;
+	int count;
+	int next;
+	pthread_mutex_t lock;
+	const struct inst* insts;
+	size_t n;
+	struct inst** parts; // input of each sim, for sims replaying different instructions, else NULL
+	size_t* partLens;
 };
 
 static const char delims[] = " \t\n";
-static const int NUM_VPAGES = 64;
+static const int MIN_VPAGE_BITS = 6; // the classic 64 page address space
+static const int MAX_VPAGE_BITS = 48;
+static const int MAX_PROCS = 1 << 14; // pids sit above the vpage bits of 64-bit page keys, below TLB_HUGE_SHIFT
+static const int PT_BITS = 9; // vpage bits resolved per page table level
+static const unsigned long PT_FANOUT = 1UL << 9;
+static const unsigned long VMATABLE_MAX = 1UL << 12; // largest address space given a flat vmatable
+static const int INST_CHUNK = 4096; // instructions decoded per batch when streaming
+static const char ALL_PAGERS[] = "fscrnalowWACP";
+static const char STACK_PAGERS[] = "l"; // pagers with the inclusion property, curves come from stack distances
+static const char OFFLINE_PAGERS[] = "o"; // pagers that need the whole trace and its next-use index up front
+static const char HISTORY_PAGERS[] = "ACP"; // pagers that keep ghosts of evicted pages in a history pool
+static const int HIST_T1 = 0, HIST_T2 = 1, HIST_B1 = 2, HIST_B2 = 3; // history lists; CLOCK-Pro's clock is HIST_RING
+static const int HIST_RING = 0;
+static const unsigned char HIST_NONE = 0xff;
+static const unsigned char HIST_FRESH = 0x1; // admitted, the reference that faulted it in is still to come
+static const unsigned char HIST_HOT = 0x2;
+static const unsigned char HIST_TEST = 0x4; // cold page in its test period
+static const size_t NEVER = (size_t) -1; // next use of a page that is not referenced again
 static int NUM_FRAMES;
-static int procCount = 0;
-static struct process* procArray = NULL;
-static struct process CURRENT_PROCESS;
-static char operation;
-static unsigned int curr_vpage;
-static struct frame_t* frametable = NULL;
-static int freeFrame = 0; // count of free frames...max is NUM_FRAMES, then paging starts
-static char PAGER;
-static int frameInd = 0; // index into the frametable...incrememnted when you choose victim frame
-static bool PAGER_ON = false;
-static unsigned long instCount = 0;
-static unsigned long ctxSwitches = 0;
-static unsigned long cost = 0;
-static int ofs = 0;
+static char PAGERS[sizeof(ALL_PAGERS)];
+static int MRC_LO = 0, MRC_HI = 0, MRC_STEP = 1; // frame counts swept by -m
+static int TLB_ENTRIES = 0, TLB_WAYS = 4; // -t entries[:ways[:lru|fifo|random[:asid|flush]]], 0 entries is no TLB
+static char TLB_POLICY = 'l';
+static bool TLB_ASID = false; // keep entries across context switches instead of flushing
+static const int TLB_MISS_COST = 20; // page walk on a TLB miss
+static unsigned long HUGE_PAGES[3] = { 1, 512, 262144 }; // base pages per huge size class: 2MB and 1GB of 4KB pages, -H
+static int HUGE_SHIFT[3] = { 0, 9, 18 };
+static unsigned long KHUGEPAGED = 0; // -k interval: fault base pages in huge vmas and collapse them every N instructions
+static const int TLB_HUGE_SHIFT = 62; // TLB keys of huge mappings carry their size class in the top bits
+static unsigned long WS_TAU = 100; // -w working set window, in virtual time of the page's process
+static int KSWAPD_LOW = 0, KSWAPD_HIGH = 0; // -d free frame watermarks for background reclaim, 0 is off
+static unsigned long READAHEAD_MAX = 0; // -R largest readahead window in pages, 0 is off
+static const int READAHEAD_IO_COST = 300; // per page of a batched read, against 2500/3000 for one on its own
+static unsigned long SNAP_INTERVAL = 0; // -i instructions between statistics snapshots, 0 is off
+static const int COW_COPY_COST = 200; // copying a page on a COW fault, on top of the map
+static const unsigned int MAX_OBJECT = 65535; // shared object ids share the pagemap's 16 pid bits
+static const unsigned long OBJECT_KEY = 1UL << 63; // history keys of object pages, apart from every page_key()
+static int NUMA_NODES = 1; // -N nodes[:first|interleave[:remote cost]]
+static char NUMA_POLICY = 'f'; // place pages on the faulting process's home node (f) or by vpage across nodes (i)
+static unsigned long NUMA_REMOTE_COST = 1; // extra cost of a reference to a frame on another node
+static char LOCAL_QUOTAS = 0; // -L: per-process frames fixed (f), proportional to vma size (p) or page fault frequency driven (F); 0 is global replacement
+static double PFF_LOW = 0.01, PFF_HIGH = 0.05; // -L pff: faults per reference below which a process gives frames up, above which it gets more
+static const int LOCAL_EPOCH = 65536; // instructions split among the processes per round, and between -L pff rebalances
+static const int PFF_GROWTH = 4; // -L pff keeps a process within this many times its starting quota
 static int* randVals;
 static int randCount;
-static int requests; // number of paging requests (select_victim frame calls)
+static bool RAND_SEEDED = false; // -s: myrandom draws from a seeded xoshiro256** and there is no rfile
+static unsigned long RAND_SEED = 0;
 static bool PRINT_INSTR = false, PRINT_PTE = false, PRINT_FT = false, PRINT_SUM = false;
-static struct node* CURR_CLOCK_HAND = NULL;
-static struct list* clockList;
-static bool START_CLOCK = true;
-
-struct frame_t* get_frame();
-struct frame_t* allocate_frame_from_free_list();
-struct frame_t* select_victim_frame();
-struct frame_t* select_victim_frame_fifo();
-struct frame_t* select_victim_frame_second_chance();
-struct frame_t* select_victim_frame_clock();
-struct frame_t* select_victim_frame_random();
-struct frame_t* select_victim_frame_nru();
-struct frame_t* select_victim_frame_aging();
-void createFrameTable();
+static char* EVENT_LOG = NULL; // -l file: the -oO events go there in binary, see mmutrace.h
+static char* GENERATOR = NULL; // -g spec: run on a synthetic trace instead of an input file, see openGenerator
+static char* BATCH_LIST = NULL; // -b file listing the traces of a batch run
+static char* CKPT_FILE = NULL; // -c interval:file, checkpoint the run every CKPT_INTERVAL instructions
+static unsigned long CKPT_INTERVAL = 0;
+static char* RESUME_FILE = NULL; // -C file, start from a checkpoint
+static const char CKPT_MAGIC[] = "\x89MMUCKP\n";
+static const size_t CKPT_PROBE = 1 << 16; // leading bytes of the input hashed into a checkpoint's trace fingerprint
+static int THREADS = 0; // -j worker threads for batches and multi-sim runs, 0 for one per online cpu
+static const size_t OUTBUF_SIZE = 1 << 20;
+
+struct sim* createSim(const struct layout* layout, char pager, int num_frames);
+void freeSim(struct sim* sim);
+void parsePagers(char* arg);
+void parseTlb(char* arg);
+void parseHugePages(char* arg);
+void parseWatermarks(char* arg);
+void parseNuma(char* arg);
+void parseLocal(char* arg);
+void parseCheckpoint(char* arg);
+void runPagers(struct trace* tr);
+void runCheckpointed(struct trace* tr);
+void runLocal(struct trace* tr);
+void localQuotas(const struct layout* layout, int* quotas);
+void rebalanceQuotas(struct sim** sims, int count, const int* caps, unsigned long epoch);
+void limitFrames(struct sim* sim, int limit);
+void runMissRatioCurve(struct trace* tr);
+void stackDistanceCurve(struct trace* tr);
+void simulatedCurve(struct trace* tr);
+void printCurvePoint(int frames, struct pstat_t* total, unsigned long refs, unsigned long baseCost);
+unsigned long pstatCost(struct pstat_t* pstat);
+void runSims(struct sim** sims, int count, const struct inst* insts, size_t n);
+void runSimParts(struct sim** sims, int count, struct inst** parts, size_t* lens);
+void runPool(struct pool* pool);
+int poolThreads(int count);
+void runBatch(char* listfile);
+void* runBatchThread(void* arg);
+void runBatchTrace(char* filename);
+void* runSimThread(void* arg);
+void finishSim(struct sim* sim);
+struct inst* loadTrace(struct trace* tr, size_t* count);
+size_t* createNextUse(const struct layout* layout, const struct inst* insts, size_t count);
+size_t read_instructions(struct trace* tr, struct inst* insts, size_t max);
+struct frame_t* get_frame(struct sim* sim, int node);
+struct pte_t* translate(struct sim* sim, struct process* proc, unsigned long vpage);
+struct frame_t* map_page(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte);
+struct frame_t* install_page(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte);
+void readahead(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte);
+unsigned long readahead_init_size(unsigned long max);
+unsigned long readahead_next_size(unsigned long size, unsigned long max);
+void unmap_frame(struct sim* sim, struct frame_t* frame);
+void map_shared(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte);
+void cow_break(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte);
+int object_page(struct sim* sim, struct vma_t* vma, unsigned long vpage);
+void rmap_add(struct sim* sim, struct frame_t* frame, unsigned int pid, unsigned long vpage, struct pte_t* pte);
+void rmap_remove(struct sim* sim, struct frame_t* frame, struct pte_t* pte);
+void unmap_sharers(struct sim* sim, struct frame_t* frame);
+unsigned long frame_key(struct sim* sim, struct frame_t* frame);
+void kswapd(struct sim* sim);
+void shrink_frames(struct sim* sim);
+void release_frame(struct sim* sim, struct frame_t* frame);
+void pager_release(struct sim* sim, int fid);
+bool map_huge(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma);
+bool populate_huge(struct sim* sim, struct process* proc, struct vma_t* vma, unsigned long base, unsigned long first);
+void split_huge(struct sim* sim, struct process* proc, unsigned long vpage, struct pte_t* pte);
+void khugepaged_scan(struct sim* sim);
+void pager_mapped(struct sim* sim, int fid);
+struct frame_t* allocate_frame_from_free_list(struct sim* sim, int node);
+struct frame_t* node_free_frame(struct sim* sim, int node);
+int place_node(struct sim* sim, struct process* proc, unsigned long vpage);
+struct numa_node* createNodes(struct frame_t* frametable, int num_frames);
+struct frame_t* select_victim_frame(struct sim* sim);
+struct frame_t* select_victim_local(struct sim* sim, int node);
+struct frame_t* select_victim_frame_fifo(struct sim* sim);
+struct frame_t* select_victim_frame_second_chance(struct sim* sim);
+struct frame_t* select_victim_frame_clock(struct sim* sim);
+struct frame_t* select_victim_frame_random(struct sim* sim);
+struct frame_t* select_victim_frame_nru(struct sim* sim);
+struct frame_t* select_victim_frame_aging(struct sim* sim);
+int clock_sweep(struct sim* sim, int hand);
+int aging_sweep(unsigned int* ages, const unsigned long* refbits, int n);
+int aging_sweep_scalar(unsigned int* ages, const unsigned long* refbits, int from, int n, int minFid);
+struct frame_t* select_victim_frame_lru(struct sim* sim);
+struct frame_t* select_victim_frame_ws(struct sim* sim);
+struct frame_t* select_victim_frame_wsclock(struct sim* sim);
+unsigned long page_age(struct sim* sim, int fid);
+struct frame_t* select_victim_frame_arc(struct sim* sim);
+struct frame_t* select_victim_frame_car(struct sim* sim);
+struct frame_t* select_victim_frame_clockpro(struct sim* sim);
+void pager_fault(struct sim* sim, unsigned long key);
+void pager_admit(struct sim* sim, int fid);
+int ghost_hit(struct sim* sim, unsigned long key);
+void arc_fault(struct sim* sim, unsigned long key);
+void arc_admit(struct sim* sim, int fid);
+void car_make_room(struct sim* sim);
+struct frame_t* evict_to_ghost(struct sim* sim, int from, int to);
+void adapt_referenced(struct sim* sim, int fid);
+void clockpro_admit(struct sim* sim, int fid);
+void clockpro_hand_hot(struct sim* sim);
+void clockpro_hand_test(struct sim* sim);
+void clockpro_end_test(struct sim* sim, int e);
+void clockpro_unlink(struct sim* sim, int e);
+void clockpro_push(struct sim* sim, int e);
+struct frame_t* select_victim_frame_opt(struct sim* sim);
+void pager_referenced(struct sim* sim, int fid);
+void lru_touch(struct sim* sim, int fid);
+void lru_unlink(struct sim* sim, int fid);
+void opt_touch(struct sim* sim, int fid);
+void opt_remove(struct sim* sim, int fid);
+void opt_sift_up(struct sim* sim, int pos);
+void opt_sift_down(struct sim* sim, int pos);
+void opt_swap(struct sim* sim, int a, int b);
+unsigned long nru_class(struct sim* sim, int c, int w);
+int nth_set_bit(unsigned long word, int n);
+unsigned long* createBitmap(int bits);
+void set_bit(unsigned long* map, int i);
+void clear_bit(unsigned long* map, int i);
+void clear_referenced(struct sim* sim, int w, unsigned long mask);
+struct frame_t* createFrameTable(int num_frames);
 struct pstat_t* createPstat();
 struct pte_t* createPageTable();
-void createProcArray(FILE* fp);
+struct pte_t* lookup_pte(struct process* proc, unsigned long vpage, bool alloc);
+void freePageTable(void* node, int level);
+void createVmaLookups(struct layout* layout);
+int compareVmas(const void* a, const void* b);
+void vma_tree_build(struct process* proc, int lo, int hi);
+void vma_tree_find(struct process* proc, int lo, int hi, unsigned long vpage, struct vma_t** best);
+struct pagemap* createPageMap();
+int pagemap_index(struct pagemap* map, unsigned int pid, unsigned long vpage);
+void freePageMap(struct pagemap* map);
+struct history* createHistory(int cap);
+void freeHistory(struct history* h);
+unsigned long page_key(unsigned int pid, unsigned long vpage);
+int hist_find(struct history* h, unsigned long key);
+int hist_add(struct history* h, unsigned long key, int frame);
+void hist_drop(struct history* h, int e);
+void hist_rekey(struct history* h, int e, unsigned long key);
+void hist_insert(struct history* h, int l, int e, int at);
+void hist_unlink(struct history* h, int e);
+int hist_next(struct history* h, int e);
+void createProcArray(struct trace* tr);
+void createProcArrayBinary(struct trace* tr, struct layout* layout);
+struct process* createSimProcArray(const struct layout* layout);
+void freeLayout(struct layout* layout);
+struct vma_t* createVma(unsigned long start, unsigned long end, unsigned int write_protect, unsigned int filemapped, unsigned int huge);
+void parseShare(struct vma_t* vma, const char* spec);
+struct vma_t** createVmaTable(struct list* vma_list, unsigned long numVpages);
 struct list* createList();
-unsigned int* createAges();
-void initCircularClock();
+unsigned int* createAges(int num_frames);
 void add(struct list* l, void* v);
-struct vma_t* find_vma_list();
-void printFrameTable();
-void printProcess();
-void printList(struct list* l);
-void printPageTable(struct pte_t* pagetable);
-void printStats();
-void printPageTables();
-bool get_next_instruction(FILE* fp);
+struct vma_t* find_vma(struct process* proc, unsigned long vpage);
+void printFrameTable(struct sim* sim);
+void printFrames(struct sim* sim);
+void printStats(struct sim* sim);
+void printSnapshot(struct sim* sim);
+unsigned long tlbCost(struct sim* sim);
+unsigned long readaheadCost(struct sim* sim);
+unsigned long shareCost(struct sim* sim);
+unsigned long numaCost(struct sim* sim);
+struct tlb* createTlb();
+void freeTlb(struct tlb* tlb);
+unsigned long tlb_key(unsigned int pid, unsigned long vpage);
+unsigned long tlb_huge_key(unsigned int pid, unsigned long vpage, int huge);
+bool tlb_lookup(struct tlb* tlb, unsigned long tag, unsigned long key, struct pte_t** pte);
+void tlb_fill(struct tlb* tlb, unsigned long tag, unsigned long key, struct pte_t* pte);
+void tlb_fill_pte(struct sim* sim, struct process* proc, unsigned long vpage, struct pte_t* pte);
+void tlb_invalidate(struct tlb* tlb, unsigned long tag, unsigned long key);
+void tlb_flush(struct tlb* tlb);
+void printPageTables(struct sim* sim);
+void printPageTable(struct sim* sim, int pid);
+void printLocalStats(struct sim** sims, int count, const int* minQuotas, const int* maxQuotas);
+void printPageTableLeaves(struct sim* sim, void* node, int level, unsigned long base);
+struct trace* openTrace(char* filename);
+void detectBinary(struct trace* tr);
+void closeTrace(struct trace* tr);
+bool trace_gets(struct trace* tr, char* line, int size);
+int trace_byte(struct trace* tr);
+long trace_tell(struct trace* tr);
+void trace_seek(struct trace* tr, long pos);
+unsigned long trace_varint(struct trace* tr);
+bool get_next_binary_instruction(struct trace* tr, struct inst* in);
+const char* scan_instruction(const char* p, const char* end, struct inst* in);
+bool get_next_instruction(struct trace* tr, struct inst* in);
 void createRandArray(char* filename);
-int myrandom(int size);
-void runSimulation(FILE* fp);
+void rng_seed(struct rng* rng, unsigned long seed);
+unsigned long rng_next(struct rng* rng);
+unsigned long rng_below(struct rng* rng, unsigned long n);
+double rng_double(struct rng* rng);
+struct trace* openGenerator(char* spec);
+void parseGenerator(struct generator* g, char* spec);
+void closeGenerator(struct generator* g);
+void* runGenerator(void* arg);
+size_t gen_fill(struct generator* g, struct inst* insts, size_t max);
+size_t gen_read(struct generator* g, struct inst* insts, size_t max);
+unsigned long gen_page(struct generator* g);
+unsigned long gen_zipf(struct generator* g);
+int myrandom(struct sim* sim, int size);
+void runSimulation(struct sim* sim, const struct inst* insts, size_t count);
+void log_inst(struct sim* sim, char op, unsigned long operand);
+void log_event(struct sim* sim, int ev, unsigned long a, unsigned long b);
+void openEventLog(struct sim* sim, const char* filename);
+void writeCheckpoint(struct sim* sim, long pos);
+void waitCheckpoint(struct sim* sim);
+long readCheckpoint(struct sim* sim, const char* filename);
+unsigned long traceFingerprint(struct trace* tr, const struct inst* insts, size_t n);
+unsigned long hash_bytes(unsigned long h, const void* p, size_t size);
+void serializeSim(struct ckpt* ck, struct sim* sim);
+void ckpt_io(struct ckpt* ck, void* p, size_t size);
+void ckpt_history(struct ckpt* ck, struct history* h, int cap);
+void ckpt_tlb(struct ckpt* ck, struct tlb* tlb);
+void ckpt_pagemap(struct ckpt* ck, struct pagemap* map);
+void ckpt_page_table(struct ckpt* ck, struct process* proc);
+void ckpt_leaves(struct ckpt* ck, void* node, int level, unsigned long base);
+struct outbuf* createOutbuf(int fd, bool owned);
+void freeOutbuf(struct outbuf* ob);
+void out_flush(struct outbuf* ob);
+void out_str(struct outbuf* ob, const char* str);
+void out_byte(struct outbuf* ob, int c);
+void out_ulong(struct outbuf* ob, unsigned long v);
+void out_varint(struct outbuf* ob, unsigned long v);
+void out_printf(struct outbuf* ob, const char* fmt, ...);
 
 
 int main(int argc, char* argv[]) {
@@ -122,10 +668,10 @@ int main(int argc, char* argv[]) {
 	int opt;
 	opterr = 0;
 
-	while ((opt = getopt (argc, argv, "a:o:f:")) != -1) {
+	while ((opt = getopt (argc, argv, "a:o:f:m:t:H:k:w:d:N:L:R:i:c:C:g:s:l:b:j:")) != -1) {
 		switch (opt) {
 			case 'a':
-				PAGER = optarg[0];
+				parsePagers(optarg);
 				break;
 
 			case 'o':
@@ -157,8 +703,100 @@ int main(int argc, char* argv[]) {
 				NUM_FRAMES = atoi(optarg);
 				break;
 
+			case 'm':
+				if(sscanf(optarg, "%d:%d:%d", &MRC_LO, &MRC_HI, &MRC_STEP) < 2 ||
+				   MRC_LO < 1 || MRC_HI < MRC_LO || MRC_STEP < 1) {
+					printf("Illegal frame range\n");
+					exit(1);
+				}
+				break;
+
+			case 't':
+				parseTlb(optarg);
+				break;
+
+			case 'H':
+				parseHugePages(optarg);
+				break;
+
+			case 'k':
+				KHUGEPAGED = strtoul(optarg, NULL, 10);
+				if(KHUGEPAGED == 0) {
+					printf("Illegal khugepaged interval\n");
+					exit(1);
+				}
+				break;
+
+			case 'w':
+				WS_TAU = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'd':
+				parseWatermarks(optarg);
+				break;
+
+			case 'N':
+				parseNuma(optarg);
+				break;
+
+			case 'L':
+				parseLocal(optarg);
+				break;
+
+			case 'i':
+				SNAP_INTERVAL = strtoul(optarg, NULL, 10);
+				if(SNAP_INTERVAL == 0) {
+					printf("Illegal snapshot interval\n");
+					exit(1);
+				}
+				break;
+
+			case 'R':
+				READAHEAD_MAX = strtoul(optarg, NULL, 10);
+				if(READAHEAD_MAX < 2) {
+					printf("Illegal readahead window\n");
+					exit(1);
+				}
+				break;
+
+			case 'c':
+				parseCheckpoint(optarg);
+				break;
+
+			case 'C':
+				RESUME_FILE = optarg;
+				break;
+
+			case 'g':
+				GENERATOR = optarg;
+				break;
+
+			case 's':
+				RAND_SEED = strtoul(optarg, NULL, 10);
+				RAND_SEEDED = true;
+				break;
+
+			case 'l':
+				EVENT_LOG = optarg;
+				PRINT_INSTR = true;
+				break;
+
+			case 'b':
+				BATCH_LIST = optarg;
+				break;
+
+			case 'j':
+				THREADS = atoi(optarg);
+				if(THREADS < 1) {
+					printf("Illegal thread count\n");
+					exit(1);
+				}
+				break;
+
 			case '?':
-				if (optopt == 'a' || optopt == 'o' || optopt == 'f') {
+				if (optopt == 'a' || optopt == 'o' || optopt == 'f' || optopt == 'm' || optopt == 't' ||
+				    optopt == 'H' || optopt == 'k' || optopt == 'w' || optopt == 'd' || optopt == 'N' || optopt == 'L' || optopt == 'R' || optopt == 'i' ||
+				    optopt == 'c' || optopt == 'C' || optopt == 'g' || optopt == 's' || optopt == 'l' || optopt == 'b' || optopt == 'j') {
 					fprintf(stderr, "Option -%c requires an argument.\n", optopt);
 				} else if(isprint(optopt)) {
 					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -172,541 +810,5100 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
-	createFrameTable();
-	FILE* fp;
+	// local replacement splits the trace by process, so there is no single event order or sim state
+	if(LOCAL_QUOTAS && (BATCH_LIST || MRC_HI || EVENT_LOG || CKPT_FILE || RESUME_FILE || PRINT_INSTR ||
+	   SNAP_INTERVAL || KSWAPD_LOW || NUMA_NODES > 1 || strlen(PAGERS) > 1 || strchr(OFFLINE_PAGERS, PAGERS[0]))) {
+		printf("Illegal options for local replacement\n");
+		exit(1);
+	}
 
-	for(int i = optind; i < argc; i++) {
+	// checkpoints hold the state of one sim and the position in one trace
+	if((CKPT_FILE || RESUME_FILE) && (BATCH_LIST || MRC_HI || EVENT_LOG || strlen(PAGERS) > 1)) {
+		printf("Illegal options for a checkpoint\n");
+		exit(1);
+	}
 
-		if(i == argc - 2) {
-			fp = fopen(argv[i], "r");
-			if(!fp) {
-				printf("Error: Could not open input file\n");
-				exit(1);
-			}
-			createProcArray(fp);
+	// the rfile is the last argument, unless -s replaces it
+	int rfileArgs = RAND_SEEDED ? 0 : 1;
+	if(!RAND_SEEDED) {
+		if(optind == argc) {
+			printf("Error: Missing rfile\n");
+			exit(1);
+		}
+		createRandArray(argv[argc - 1]);
+	}
+
+	// a batch names its traces in the list file and takes only the rfile
+	if(BATCH_LIST) {
+		if(MRC_HI || EVENT_LOG || GENERATOR || optind != argc - rfileArgs) {
+			printf("Illegal options for a batch\n");
+			exit(1);
 		}
+		runBatch(BATCH_LIST);
+		free(randVals);
+		return 0;
+	}
 
-		if(i == argc - 1) {
-			createRandArray(argv[i]);
+	struct trace* tr;
+
+	// a generated trace takes the place of the input file
+	if(GENERATOR) {
+		if(optind != argc - rfileArgs) {
+			printf("Illegal options for a generator\n");
+			exit(1);
 		}
+		tr = openGenerator(GENERATOR);
+	} else {
+		if(optind != argc - 1 - rfileArgs) {
+			printf("Error: Missing input file\n");
+			exit(1);
+		}
+		tr = openTrace(argv[optind]);
+		if(!tr) {
+			printf("Error: Could not open input file\n");
+			exit(1);
+		}
+		createProcArray(tr);
 	}
 
-	runSimulation(fp);
+	if(MRC_HI) {
+		runMissRatioCurve(tr);
+	} else if(LOCAL_QUOTAS) {
+		runLocal(tr);
+	} else if(strlen(PAGERS) > 1) {
+		runPagers(tr);
+	} else if(CKPT_FILE || RESUME_FILE) {
+		runCheckpointed(tr);
+	} else if(strchr(OFFLINE_PAGERS, PAGERS[0])) {
+		size_t n;
+		struct inst* insts = loadTrace(tr, &n);
+		struct sim* sim = createSim(tr->layout, PAGERS[0], NUM_FRAMES);
+		if(EVENT_LOG) openEventLog(sim, EVENT_LOG);
+
+		runSimulation(sim, insts, n);
+
+		finishSim(sim);
+		freeSim(sim);
+		free(insts);
+	} else {
+		struct sim* sim = createSim(tr->layout, PAGERS[0], NUM_FRAMES);
+		struct inst* chunk = (struct inst*) malloc(sizeof(struct inst) * INST_CHUNK);
+		if(EVENT_LOG) openEventLog(sim, EVENT_LOG);
+		size_t n;
 	
-	if(PRINT_PTE) printPageTables();
-	if(PRINT_FT) printFrameTable();
-	if(PRINT_SUM) printStats();
+		while((n = read_instructions(tr, chunk, INST_CHUNK)) > 0) {
+			runSimulation(sim, chunk, n);
+		}
+
+		finishSim(sim);
+		freeSim(sim);
+		free(chunk);
+	}
 
 	free(randVals);
-	free(frametable);
-	fclose(fp);
+	closeTrace(tr);
 
 	return 0;
 }
 
 
-void runSimulation(FILE* fp) {
+/*
+	-a takes a single pager, a comma separated list of pagers, or "all"
+*/
+void parsePagers(char* arg) {
 
-	while(get_next_instruction(fp)) {
+	if(strcmp(arg, "all") == 0) {
+		strcpy(PAGERS, ALL_PAGERS);
+		return;
+	}
 
-		if(PRINT_INSTR) printf("%lu: ==> %c %d\n", instCount, operation, curr_vpage);
+	if(!strchr(arg, ',')) {
+		PAGERS[0] = arg[0];
+		PAGERS[1] = '\0';
+		return;
+	}
 
-		if(operation == 'c') {
-			CURRENT_PROCESS = procArray[curr_vpage];
-			instCount++;
-			ctxSwitches++;
-			cost += 121;
+	int n = 0;
+	PAGERS[0] = '\0';
+	for(char* p = strtok(arg, ","); p != NULL; p = strtok(NULL, ",")) {
+		if(strlen(p) != 1 || !strchr(ALL_PAGERS, p[0])) {
+			printf("Illegal pager type\n");
+			exit(1);
+		}
+		if(strchr(PAGERS, p[0])) {
 			continue;
 		}
+		PAGERS[n++] = p[0];
+		PAGERS[n] = '\0';
+	}
+}
 
-		cost++;
-		struct pte_t* pte = &(CURRENT_PROCESS.pagetable[curr_vpage]);
-		struct vma_t* vma = NULL;
-
-		if(!pte->present) {
-
-			if(!(vma = find_vma_list())) {
-				if(PRINT_INSTR) printf("  SEGV\n");
-				CURRENT_PROCESS.pstat->segv++;
-				instCount++;
-				continue;
-			}
-
-			// get victim frame and reset its proc,vpage entry
-			struct frame_t* newframe = get_frame();
-
-			if(PAGER_ON) {
-				if(PRINT_INSTR) printf("  UNMAP %d:%d\n", newframe->pid, newframe->vpage);
-
-				struct process* oldProc = &(procArray[newframe->pid]);
-				oldProc->pstat->unmaps++;
-				struct pte_t* oldPTE = &(procArray[newframe->pid].pagetable[newframe->vpage]);
-				oldPTE->present = 0;
-
-				// if page was modified, we have page out to disk (swap device) or re-map to file
-				if(oldPTE->modified) {
-					if(oldPTE->filemapped) {
-						if(PRINT_INSTR) printf("  FOUT\n");
-						oldProc->pstat->fouts++;
-					} else {
-						if(PRINT_INSTR) printf("  OUT\n");
-						oldProc->pstat->outs++;
-						oldPTE->pagedout = 1;
-					}
-				}
-			}
-
-			pte->present = 1; // we are giving this page a frame in memory so present is set to 1
-			pte->write_protect = vma->write_protect;
-			pte->filemapped = vma->filemapped;
-			pte->frame = newframe->fid; // assign victim frame to pte
-			newframe->pid = CURRENT_PROCESS.pid; // set reverse mapping vals for newframe 
-			newframe->vpage = curr_vpage;
-			pte->modified = 0;
+/*
+	-t entries[:ways[:policy[:tagging]]] puts a TLB in front of the page
+	tables. ways defaults to 4 and entries / ways must be a power of two;
+	policy is lru (default), fifo or random; tagging is flush (default,
+	flush on every switch to another process) or asid.
+*/
+void parseTlb(char* arg) {
 
-			if(pte->pagedout) {
-				if(pte->filemapped) {
-					if(PRINT_INSTR) printf("  FIN\n");
-					CURRENT_PROCESS.pstat->fins++;
-				} else {
-					if(PRINT_INSTR) printf("  IN\n");
-					CURRENT_PROCESS.pstat->ins++;
-				}
+	char* p = strtok(arg, ":");
+	TLB_ENTRIES = p ? atoi(p) : 0;
 
-			} else {
-				if(pte->filemapped) {
-					if(PRINT_INSTR) printf("  FIN\n");
-					CURRENT_PROCESS.pstat->fins++;
-				} else {
-					if(PRINT_INSTR) printf("  ZERO\n");
-					CURRENT_PROCESS.pstat->zeros++;
-				}
-			}
+	if((p = strtok(NULL, ":"))) {
+		TLB_WAYS = atoi(p);
+	}
 
-			if(PRINT_INSTR) printf("  MAP %d\n", pte->frame);
-			CURRENT_PROCESS.pstat->maps++;
+	if((p = strtok(NULL, ":"))) {
+		if(strcmp(p, "lru") == 0 || strcmp(p, "fifo") == 0 || strcmp(p, "random") == 0) {
+			TLB_POLICY = p[0];
+		} else {
+			printf("Illegal TLB replacement policy\n");
+			exit(1);
 		}
+	}
 
-		pte->referenced = 1; // set to 1 for any r/w operation
-		// if op is a write but write_protect is set for pte, issue segprot. Otherise, set modified to 1 
-		if(operation == 'w') {
-			if(pte->write_protect) {
-				printf("  SEGPROT\n");
-				CURRENT_PROCESS.pstat->segprot++;
-			} else {
-				pte->modified = 1;
-			}
+	if((p = strtok(NULL, ":"))) {
+		if(strcmp(p, "asid") == 0) {
+			TLB_ASID = true;
+		} else if(strcmp(p, "flush") != 0) {
+			printf("Illegal TLB tagging\n");
+			exit(1);
 		}
-
-		instCount++;
 	}
-}
-
 
-struct frame_t* get_frame() {
-
-	struct frame_t* frame = allocate_frame_from_free_list();
-	
-	// if no more free frames, call paging algorithm
-	if(frame == NULL) {
-		PAGER_ON = true;
-		requests++;
-		frame = select_victim_frame();
+	int sets = (TLB_WAYS > 0) ? TLB_ENTRIES / TLB_WAYS : 0;
+	if(TLB_ENTRIES < 1 || TLB_WAYS < 1 || TLB_ENTRIES % TLB_WAYS != 0 || (sets & (sets - 1)) != 0) {
+		printf("Illegal TLB geometry\n");
+		exit(1);
 	}
-
-	return frame;
 }
 
-// if freeInd is > 63, can't allocate so return NULL.
-struct frame_t* allocate_frame_from_free_list() {
+/*
+	-H pages2m[:pages1g] overrides the base pages per huge page of size
+	classes 1 and 2, both powers of two, so small traces can exercise them
+*/
+void parseHugePages(char* arg) {
 
-	if(freeFrame < NUM_FRAMES) {
-		return &frametable[freeFrame++];
+	unsigned long small = 0, large = HUGE_PAGES[2];
+	if(sscanf(arg, "%lu:%lu", &small, &large) < 1 || small < 2 || large < small ||
+	   (small & (small - 1)) != 0 || (large & (large - 1)) != 0) {
+		printf("Illegal huge page size\n");
+		exit(1);
 	}
-	return NULL;
-}
 
-
-/* 	
-	virtual function C implementation for selecting paging algorithm to evict victim frame 
-*/
-struct frame_t* select_victim_frame() {
-	switch(PAGER) {
-		case 'f':
-			return select_victim_frame_fifo();
-			break;
-		case 's':
-			return select_victim_frame_second_chance();
-			break;
-		case 'c':
-			return select_victim_frame_clock();
-			break;
-		case 'r':
-			return select_victim_frame_random();
-			break;
-		case 'n':
-			return select_victim_frame_nru();
-			break;
-		case 'a':
-			return select_victim_frame_aging();
-			break;
-		default:
-			printf("Illegal pager type\n");
-			exit(1);
+	HUGE_PAGES[1] = small;
+	HUGE_PAGES[2] = large;
+	for(int h = 1; h < 3; h++) {
+		HUGE_SHIFT[h] = __builtin_ctzl(HUGE_PAGES[h]);
 	}
 }
 
+// -d low:high free frame watermarks, see kswapd
+void parseWatermarks(char* arg) {
 
-struct frame_t* select_victim_frame_fifo() {
-
-	if(frameInd == NUM_FRAMES) {
-		frameInd = 0;
+	if(sscanf(arg, "%d:%d", &KSWAPD_LOW, &KSWAPD_HIGH) < 2 || KSWAPD_LOW < 1 || KSWAPD_HIGH < KSWAPD_LOW) {
+		printf("Illegal watermarks\n");
+		exit(1);
 	}
-
-	return &frametable[frameInd++];
 }
 
+// -N nodes[:first|interleave[:remote cost]], see place_node
+void parseNuma(char* arg) {
 
-struct frame_t* select_victim_frame_second_chance() {
+	char* p = strtok(arg, ":");
+	NUMA_NODES = p ? atoi(p) : 0;
 
-	if(frameInd == NUM_FRAMES) {
-		frameInd = 0;
+	if((p = strtok(NULL, ":"))) {
+		if(strcmp(p, "first") == 0 || strcmp(p, "interleave") == 0) {
+			NUMA_POLICY = p[0];
+		} else {
+			printf("Illegal NUMA policy\n");
+			exit(1);
+		}
 	}
 
-	struct frame_t* frame = &frametable[frameInd];
-	struct pte_t* pte = &(procArray[frame->pid].pagetable[frame->vpage]);
-
-	// reset R bit, advance frame index
-	if(pte->referenced && pte->present) {
-		 pte->referenced = 0;
-		 frameInd++;
-		 return select_victim_frame_second_chance();
+	if((p = strtok(NULL, ":"))) {
+		NUMA_REMOTE_COST = strtoul(p, NULL, 10);
 	}
 
-	return &frametable[frameInd++];
+	if(NUMA_NODES < 1 || NUMA_NODES > 64) {
+		printf("Illegal NUMA node count\n");
+		exit(1);
+	}
 }
 
+// -L fixed|prop|pff[:low:high], see runLocal
+void parseLocal(char* arg) {
 
-struct frame_t* select_victim_frame_clock() {
-
-	if(START_CLOCK) {
-		initCircularClock();
-		START_CLOCK = false;
+	char* p = strtok(arg, ":");
+	if(p && strcmp(p, "fixed") == 0) {
+		LOCAL_QUOTAS = 'f';
+	} else if(p && strcmp(p, "prop") == 0) {
+		LOCAL_QUOTAS = 'p';
+	} else if(p && strcmp(p, "pff") == 0) {
+		LOCAL_QUOTAS = 'F';
+	} else {
+		printf("Illegal local replacement quota\n");
+		exit(1);
 	}
 
-	struct frame_t* evictedFrame = NULL;
-	struct frame_t* frame = (struct frame_t*) CURR_CLOCK_HAND->val;
-	struct pte_t* pte = &(procArray[frame->pid].pagetable[frame->vpage]);
-
-	if(pte->referenced && pte->present) {
-		pte->referenced = 0;
-		CURR_CLOCK_HAND = CURR_CLOCK_HAND->next;
-		return select_victim_frame_clock();
+	if((p = strtok(NULL, ":"))) {
+		char* high = strtok(NULL, ":");
+		PFF_LOW = atof(p);
+		PFF_HIGH = high ? atof(high) : -1;
+		if(LOCAL_QUOTAS != 'F' || PFF_LOW < 0 || PFF_HIGH < PFF_LOW) {
+			printf("Illegal page fault frequency thresholds\n");
+			exit(1);
+		}
 	}
-
-	evictedFrame = (struct frame_t*) CURR_CLOCK_HAND->val;
-	CURR_CLOCK_HAND = CURR_CLOCK_HAND->next;
-	return evictedFrame;
 }
 
+// -c interval:file, see runCheckpointed
+void parseCheckpoint(char* arg) {
 
-struct frame_t* select_victim_frame_random() {
-
-	return &frametable[myrandom(NUM_FRAMES)];
+	char* sep = strchr(arg, ':');
+	CKPT_INTERVAL = strtoul(arg, NULL, 10);
+	if(!sep || sep[1] == '\0' || CKPT_INTERVAL == 0) {
+		printf("Illegal checkpoint\n");
+		exit(1);
+	}
+	CKPT_FILE = sep + 1;
 }
 
-
-struct frame_t* select_victim_frame_nru() {
-
-	int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
-	struct frame_t* array[4][NUM_FRAMES];
-	struct frame_t* frame;
-	struct pte_t* pte;
-
-	for(int i = 0; i < NUM_FRAMES; i++) {
-	
-		frame = &frametable[i];
-		pte = &(procArray[frame->pid].pagetable[frame->vpage]);
-
-		if(pte->present) { 
-			if(!(pte->referenced) && !(pte->modified)) {
-				array[0][c0++] = frame;
-			} else if(!(pte->referenced) && pte->modified) {
-				array[1][c1++] = frame;
-			} else if(pte->referenced && !(pte->modified)) {
-				array[2][c2++] = frame;
-			} else if(pte->referenced && pte->modified) {
-				array[3][c3++] = frame;
-			}
+/*
+	Several pagers over one trace: the trace is decoded once into a shared
+	read-only buffer and every pager replays it with its own frametable, page
+	tables and pstats (see runSims). Each run writes to a private temp file
+	that is copied to stdout in pager order, headed by a "PAGER <c>" line; the
+	summary is always printed so every pager reports its TOTALCOST. With -l
+	each pager logs its events to <file>.<c>.
+*/
+void runPagers(struct trace* tr) {
+
+	int count = strlen(PAGERS);
+	size_t n;
+	struct inst* insts = loadTrace(tr, &n);
+	struct sim* sims[count];
+	FILE* tmps[count];
+	PRINT_SUM = true;
+
+	for(int i = 0; i < count; i++) {
+		sims[i] = createSim(tr->layout, PAGERS[i], NUM_FRAMES);
+		tmps[i] = tmpfile();
+		if(!tmps[i]) {
+			printf("Error: Could not create temp file\n");
+			exit(1);
 		}
+		freeOutbuf(sims[i]->out);
+		sims[i]->out = createOutbuf(fileno(tmps[i]), false);
 
-		// reset referenced bit every 10th request
-		if((requests % 10) == 0) {
-			pte->referenced = 0; 
+		if(EVENT_LOG) {
+			char filename[strlen(EVENT_LOG) + 3];
+			sprintf(filename, "%s.%c", EVENT_LOG, PAGERS[i]);
+			openEventLog(sims[i], filename);
 		}
 	}
 
-	// select a random frame from lowest non-empty class
-	for(int i = 0; i < 4; i++) {
-		if(c0) {
-			return array[0][myrandom(c0)];
-		} else if(c1) {
-			return array[1][myrandom(c1)];
-		} else if(c2) {
-			return array[2][myrandom(c2)];
-		} else if(c3) {
-			return array[3][myrandom(c3)];
+	runSims(sims, count, insts, n);
+
+	char buf[BUFSIZ];
+	for(int i = 0; i < count; i++) {
+		finishSim(sims[i]);
+		freeSim(sims[i]);
+
+		printf("PAGER %c\n", PAGERS[i]);
+		rewind(tmps[i]);
+		size_t len;
+		while((len = fread(buf, 1, sizeof(buf), tmps[i])) > 0) {
+			fwrite(buf, 1, len, stdout);
 		}
+		fclose(tmps[i]);
 	}
 
-	return NULL;
+	free(insts);
 }
 
+/*
+	One pager over one trace with -c and/or -C: the run writes its whole state
+	to CKPT_FILE every CKPT_INTERVAL instructions and can start from such a
+	checkpoint instead of from scratch. Online pagers stream and checkpoint at
+	the first chunk boundary past each interval, keeping the trace offset to
+	seek back to; OPT replays its loaded buffer in interval-sized slices and
+	only needs the instruction count. Output is flushed before each checkpoint
+	is taken, so a resumed run carries on from the line after it.
+*/
+void runCheckpointed(struct trace* tr) {
 
-struct frame_t* select_victim_frame_aging() {
-
-	struct pte_t* pte = NULL;
-	unsigned int* ageVec = NULL;
-	unsigned int vpage;
-	for(int i = 0; i < NUM_FRAMES; i++) {
-		pte = &(procArray[frametable[i].pid].pagetable[frametable[i].vpage]);
-		ageVec = procArray[frametable[i].pid].ages;
-		vpage = frametable[i].vpage; 
-
-		if(pte->referenced) {
-			ageVec[vpage] = 0x80000000 | (ageVec[vpage] >> 1);
-			pte->referenced = 0;
+	bool offline = strchr(OFFLINE_PAGERS, PAGERS[0]);
+	if(!offline && !tr->buf && trace_tell(tr) < 0) {
+		printf("Error: Checkpoints need a seekable trace\n");
+		exit(1);
+	}
 
-		} else {
-			ageVec[vpage] = ageVec[vpage] >> 1;
+	size_t n = 0;
+	struct inst* insts = offline ? loadTrace(tr, &n) : (struct inst*) malloc(sizeof(struct inst) * INST_CHUNK);
+	tr->layout->fingerprint = traceFingerprint(tr, insts, n);
+	struct sim* sim = createSim(tr->layout, PAGERS[0], NUM_FRAMES);
+
+	if(RESUME_FILE) {
+		long pos = readCheckpoint(sim, RESUME_FILE);
+		if(!offline) {
+			trace_seek(tr, pos);
+		} else if(sim->instCount > n) {
+			printf("Error: Checkpoint is past the end of the trace\n");
+			exit(1);
 		}
 	}
 
-	struct frame_t* minFrame = NULL;
-	unsigned int minAge = UINT_MAX;
-	// get min age frame
-	for(int i = 0; i < NUM_FRAMES; i++) {
-		if(procArray[frametable[i].pid].ages[frametable[i].vpage] < minAge) {
-			minAge = procArray[frametable[i].pid].ages[frametable[i].vpage];
-			minFrame = &frametable[i];
+	unsigned long next = CKPT_FILE ? (sim->instCount / CKPT_INTERVAL + 1) * CKPT_INTERVAL : ULONG_MAX;
+
+	if(offline) {
+		size_t done = sim->instCount;
+		while(done < n) {
+			size_t len = (n - done < next - done) ? n - done : next - done;
+			runSimulation(sim, insts + done, len);
+			done += len;
+			if(done == next) {
+				writeCheckpoint(sim, done);
+				next += CKPT_INTERVAL;
+			}
+		}
+	} else {
+		while((n = read_instructions(tr, insts, INST_CHUNK)) > 0) {
+			runSimulation(sim, insts, n);
+			if(sim->instCount >= next) {
+				writeCheckpoint(sim, trace_tell(tr));
+				next = (sim->instCount / CKPT_INTERVAL + 1) * CKPT_INTERVAL;
+			}
 		}
 	}
+	waitCheckpoint(sim);
 
-	struct process* proc = &(procArray[minFrame->pid]);
-	proc->ages[minFrame->vpage] = 0;
-	struct pte_t* oldPTE = &(proc->pagetable[minFrame->vpage]);
-	oldPTE->referenced = 0;
-
-	return minFrame;
+	finishSim(sim);
+	freeSim(sim);
+	free(insts);
 }
 
+/*
+	Local replacement (-L): each process owns a quota of frames and its faults
+	only evict its own pages. Processes are then independent, so each gets a
+	sim of its own, with its quota as the frametable, and the trace is read
+	LOCAL_EPOCH instructions at a time, split by process and replayed on -j
+	threads. A process's TLB is its own and is never flushed. Under pff the
+	quotas start proportional and, after each epoch, a process that faulted
+	on more than PFF_HIGH of its references takes frames from the unassigned
+	pool, one that faulted on fewer than PFF_LOW gives some back, evicting
+	its own pages. Its sim is sized for PFF_GROWTH times the starting quota.
+*/
+void runLocal(struct trace* tr) {
 
-void createFrameTable() {
-
-	frametable = (struct frame_t*) malloc(sizeof(struct frame_t) * NUM_FRAMES);
+	const struct layout* layout = tr->layout;
+	int count = layout->procCount;
 
-	for(int i = 0; i < NUM_FRAMES; i++) {
+	if(layout->sharing) {
+		printf("Error: Shared vmas need global replacement\n");
+		exit(1);
+	}
+	if(LOCAL_QUOTAS == 'F' && strchr(HISTORY_PAGERS, PAGERS[0])) {
+		printf("Illegal pager for page fault frequency quotas\n");
+		exit(1);
+	}
+	if(NUM_FRAMES < count) {
+		printf("Error: Fewer frames than processes\n");
+		exit(1);
+	}
+
+	struct sim** sims = (struct sim**) malloc(sizeof(struct sim*) * count);
+	struct inst** parts = (struct inst**) malloc(sizeof(struct inst*) * count);
+	size_t* lens = (size_t*) malloc(sizeof(size_t) * count);
+	size_t* caps = (size_t*) malloc(sizeof(size_t) * count);
+	int* quotas = (int*) malloc(sizeof(int) * count);
+	int* frameCaps = (int*) malloc(sizeof(int) * count);
+	int* minQuotas = (int*) malloc(sizeof(int) * count);
+	int* maxQuotas = (int*) malloc(sizeof(int) * count);
+	struct inst* chunk = (struct inst*) malloc(sizeof(struct inst) * LOCAL_EPOCH);
+
+	localQuotas(layout, quotas);
+	for(int i = 0; i < count; i++) {
+		frameCaps[i] = quotas[i];
+		if(LOCAL_QUOTAS == 'F') {
+			long cap = (long) quotas[i] * PFF_GROWTH;
+			frameCaps[i] = (int) ((cap < NUM_FRAMES - count + 1) ? cap : NUM_FRAMES - count + 1);
+		}
+		sims[i] = createSim(layout, PAGERS[0], frameCaps[i]);
+		if(LOCAL_QUOTAS == 'F') {
+			limitFrames(sims[i], quotas[i]);
+		}
+		minQuotas[i] = maxQuotas[i] = quotas[i];
+		caps[i] = 64;
+		parts[i] = (struct inst*) malloc(sizeof(struct inst) * caps[i]);
+	}
+
+	// a reference goes to the process last switched to, and the switch to the process itself
+	int current = -1;
+	size_t n;
+	for(unsigned long epoch = 0; (n = read_instructions(tr, chunk, LOCAL_EPOCH)) > 0; epoch++) {
+		memset(lens, 0, sizeof(size_t) * count);
+		for(size_t i = 0; i < n; i++) {
+			if(chunk[i].op == 'c') {
+				current = (int) chunk[i].vpage;
+			}
+			if(current < 0 || current >= count) {
+				continue;
+			}
+			if(lens[current] == caps[current]) {
+				caps[current] *= 2;
+				parts[current] = (struct inst*) realloc(parts[current], sizeof(struct inst) * caps[current]);
+			}
+			parts[current][lens[current]++] = chunk[i];
+		}
+
+		runSimParts(sims, count, parts, lens);
+
+		// an epoch's SEGPROT lines fit in a sim's buffer, so they come out in pid order
+		for(int i = 0; i < count; i++) {
+			out_flush(sims[i]->out);
+		}
+
+		if(LOCAL_QUOTAS == 'F') {
+			rebalanceQuotas(sims, count, frameCaps, epoch);
+			for(int i = 0; i < count; i++) {
+				minQuotas[i] = (sims[i]->frameLimit < minQuotas[i]) ? sims[i]->frameLimit : minQuotas[i];
+				maxQuotas[i] = (sims[i]->frameLimit > maxQuotas[i]) ? sims[i]->frameLimit : maxQuotas[i];
+			}
+		}
+	}
+
+	// each process's lines come from its own sim
+	struct outbuf* out = sims[0]->out;
+	if(PRINT_PTE) {
+		for(int i = 0; i < count; i++) {
+			printPageTable(sims[i], i);
+			out_flush(sims[i]->out);
+		}
+	}
+	if(PRINT_FT) {
+		out_printf(out, "FT: ");
+		for(int i = 0; i < count; i++) {
+			struct outbuf* own = sims[i]->out;
+			sims[i]->out = out;
+			printFrames(sims[i]);
+			sims[i]->out = own;
+		}
+		out_printf(out, "\n");
+	}
+	if(PRINT_SUM) printLocalStats(sims, count, minQuotas, maxQuotas);
+	out_flush(out);
+
+	for(int i = 0; i < count; i++) {
+		freeSim(sims[i]);
+		free(parts[i]);
+	}
+	free(sims);
+	free(parts);
+	free(lens);
+	free(caps);
+	free(quotas);
+	free(frameCaps);
+	free(minQuotas);
+	free(maxQuotas);
+	free(chunk);
+}
+
+/*
+	One frame each, then the rest split by weight: 1 per process for fixed
+	quotas, its vma pages for proportional and pff. Frames left over by
+	rounding down go one each to the lowest pids.
+*/
+void localQuotas(const struct layout* layout, int* quotas) {
+
+	int count = layout->procCount;
+	unsigned long weights[count];
+	unsigned long total = 0;
+
+	for(int i = 0; i < count; i++) {
+		weights[i] = (LOCAL_QUOTAS == 'f') ? 1 : 0;
+		for(struct node* h = layout->procs[i].vma_list->head; h != NULL && LOCAL_QUOTAS != 'f'; h = h->next) {
+			struct vma_t* vma = (struct vma_t*) h->val;
+			weights[i] += vma->end_vpage - vma->start_vpage + 1;
+		}
+		total += weights[i];
+	}
+
+	int spare = NUM_FRAMES - count;
+	int given = 0;
+	for(int i = 0; i < count; i++) {
+		quotas[i] = 1 + (total ? (int) ((unsigned __int128) spare * weights[i] / total) : 0);
+		given += quotas[i];
+	}
+	for(int i = 0; given < NUM_FRAMES; i = (i + 1) % count) {
+		quotas[i]++;
+		given++;
+	}
+}
+
+/*
+	After an epoch, processes under PFF_LOW faults per reference give up an
+	eighth of their frames to the pool, then those over PFF_HIGH take an
+	eighth more from it as far as it goes, starting at a different process
+	each epoch so none is always served first. Processes that made no
+	references keep what they have.
+*/
+void rebalanceQuotas(struct sim** sims, int count, const int* caps, unsigned long epoch) {
+
+	int pool = NUM_FRAMES;
+	double rates[count];
+
+	for(int i = 0; i < count; i++) {
+		struct sim* sim = sims[i];
+		unsigned long refs = sim->instCount - sim->ctxSwitches - sim->pffRefs;
+		rates[i] = refs ? (double) (sim->faults - sim->pffFaults) / refs : -1;
+		sim->pffRefs += refs;
+		sim->pffFaults = sim->faults;
+
+		if(rates[i] >= 0 && rates[i] < PFF_LOW && sim->frameLimit > 1) {
+			sim->frameLimit -= (sim->frameLimit + 7) / 8;
+			sim->frameLimit = (sim->frameLimit < 1) ? 1 : sim->frameLimit;
+			shrink_frames(sim);
+		}
+		pool -= sim->frameLimit;
+	}
+
+	for(int k = 0; k < count && pool > 0; k++) {
+		int i = (int) ((epoch + k) % count);
+		struct sim* sim = sims[i];
+		if(rates[i] > PFF_HIGH) {
+			int more = (sim->frameLimit + 7) / 8;
+			more = (more < caps[i] - sim->frameLimit) ? more : caps[i] - sim->frameLimit;
+			more = (more < pool) ? more : pool;
+			sim->frameLimit += more;
+			pool -= more;
+		}
+	}
+}
+
+// every frame starts out free, so a sim holds no more than limit of them by taking free frames only below it
+void limitFrames(struct sim* sim, int limit) {
+
+	sim->freeList = (int*) realloc(sim->freeList, sizeof(int) * sim->num_frames);
+	for(int i = 0; i < sim->num_frames; i++) {
+		sim->freeList[i] = sim->num_frames - 1 - i;
+		set_bit(sim->freebits, i);
+	}
+	sim->numa[0].next = sim->numa[0].hi;
+	sim->numa[0].freeCount = sim->num_frames;
+	sim->freeCount = sim->num_frames;
+	sim->freeFrame = sim->num_frames;
+	sim->frameLimit = limit;
+}
+
+/*
+	-m lo:hi[:step] reports faults, miss ratio and cost for every frame count
+	in the range as "MRC <frames> <faults> <ratio> <cost>" lines. Stack
+	pagers get the whole curve from one stack-distance pass; every other
+	pager falls back to one sim per frame count replaying a shared buffer.
+*/
+void runMissRatioCurve(struct trace* tr) {
+
+	if(strlen(PAGERS) != 1) {
+		printf("Error: -m takes a single pager\n");
+		exit(1);
+	}
+
+	// the stack pass has no notion of a TLB, huge pages, kswapd, readahead or sharing, so those always simulate
+	if(strchr(STACK_PAGERS, PAGERS[0]) && !TLB_ENTRIES && !tr->layout->hugeEnabled && !KSWAPD_LOW && !READAHEAD_MAX && NUMA_NODES == 1 &&
+	   !tr->layout->sharing) {
+		stackDistanceCurve(tr);
+	} else {
+		simulatedCurve(tr);
+	}
+}
+
+/*
+	Mattson stack-distance pass. The recency stack is walked from the top for
+	each reference; the page at depth F is exactly the page a memory of F
+	frames evicts if the reference misses at F, so one walk (cut off at hi)
+	gives the faults and evictions of every frame count at once.
+
+	Dirtiness is tracked per page as a threshold: a page is dirty at every
+	frame count >= dirty[k] where it is still resident. A reference at
+	distance d reloads (cleans) the page at every count below d, and a write
+	dirties it everywhere. Whether a page was ever paged out is a bit per
+	frame count, since that depends on the count.
+*/
+void stackDistanceCurve(struct trace* tr) {
+
+	int range = MRC_HI - MRC_LO + 1;
+	int words = (range + 63) / 64;
+	struct pagemap* pages = createPageMap();
+	int npages = 0, cap = 0; // per-page arrays, grown as pages are first seen
+	int* prev = NULL;
+	int* next = NULL;
+	int* dirty = NULL;
+	bool* filemapped = NULL;
+	unsigned long* pagedout = NULL;
+	struct pstat_t* curve = (struct pstat_t*) calloc(range, sizeof(struct pstat_t));
+	struct pstat_t common = { 0 }; // segv/segprot, the same at every frame count
+	struct inst* chunk = (struct inst*) malloc(sizeof(struct inst) * INST_CHUNK);
+	unsigned long refs = 0, baseCost = 0;
+	int head = -1, pid = 0;
+	size_t n;
+
+	while((n = read_instructions(tr, chunk, INST_CHUNK)) > 0) {
+		for(size_t i = 0; i < n; i++) {
+
+			if(chunk[i].op == 'c') {
+				pid = chunk[i].vpage;
+				baseCost += 121;
+				continue;
+			}
+
+			refs++;
+			baseCost++;
+			struct vma_t* vma = find_vma(&tr->layout->procs[pid], chunk[i].vpage);
+			if(!vma) {
+				common.segv++;
+				continue;
+			}
+
+			int k = pagemap_index(pages, pid, chunk[i].vpage);
+			if(k == npages) {
+				if(npages == cap) {
+					cap = cap ? 2 * cap : 1024;
+					prev = (int*) realloc(prev, sizeof(int) * cap);
+					next = (int*) realloc(next, sizeof(int) * cap);
+					dirty = (int*) realloc(dirty, sizeof(int) * cap);
+					filemapped = (bool*) realloc(filemapped, sizeof(bool) * cap);
+					pagedout = (unsigned long*) realloc(pagedout, sizeof(unsigned long) * cap * words);
+					if(!prev || !next || !dirty || !filemapped || !pagedout) {
+						printf("Error: Out of memory tracking pages\n");
+						exit(1);
+					}
+				}
+				npages++;
+				memset(&pagedout[(size_t) k * words], 0, sizeof(unsigned long) * words);
+				filemapped[k] = vma->filemapped;
+				dirty[k] = INT_MAX;
+				prev[k] = next[k] = -1;
+			}
+
+			// walk the stack: every page above k is the victim at its depth
+			int d = INT_MAX, depth = 1;
+			for(int q = head; q != -1 && depth <= MRC_HI; q = next[q], depth++) {
+				if(q == k) {
+					d = depth;
+					break;
+				}
+				if(depth >= MRC_LO) {
+					struct pstat_t* at = &curve[depth - MRC_LO];
+					at->unmaps++;
+					if(dirty[q] <= depth) {
+						if(filemapped[q]) {
+							at->fouts++;
+						} else {
+							at->outs++;
+							pagedout[(size_t) q * words + (depth - MRC_LO) / 64] |= 1UL << ((depth - MRC_LO) % 64);
+						}
+					}
+				}
+			}
+
+			// frame counts below d miss
+			for(int f = MRC_LO; f < d && f <= MRC_HI; f++) {
+				struct pstat_t* at = &curve[f - MRC_LO];
+				at->maps++;
+				if(filemapped[k]) {
+					at->fins++;
+				} else if(pagedout[(size_t) k * words + (f - MRC_LO) / 64] & (1UL << ((f - MRC_LO) % 64))) {
+					at->ins++;
+				} else {
+					at->zeros++;
+				}
+			}
+
+			// move k to the top of the stack
+			if(head != k) {
+				if(prev[k] != -1) {
+					next[prev[k]] = next[k];
+					if(next[k] != -1) {
+						prev[next[k]] = prev[k];
+					}
+				}
+				prev[k] = -1;
+				next[k] = head;
+				if(head != -1) {
+					prev[head] = k;
+				}
+				head = k;
+			}
+
+			if(d > dirty[k]) {
+				dirty[k] = d;
+			}
+			if(chunk[i].op == 'w') {
+				if(vma->write_protect) {
+					common.segprot++;
+				} else {
+					dirty[k] = 0;
+				}
+			}
+		}
+	}
+
+	for(int f = MRC_LO; f <= MRC_HI; f += MRC_STEP) {
+		struct pstat_t* at = &curve[f - MRC_LO];
+		at->segv = common.segv;
+		at->segprot = common.segprot;
+		printCurvePoint(f, at, refs, baseCost);
+	}
+
+	free(prev);
+	free(next);
+	free(dirty);
+	free(filemapped);
+	free(pagedout);
+	free(curve);
+	free(chunk);
+	freePageMap(pages);
+}
+
+// one sim per frame count, all replaying the same decoded buffer
+void simulatedCurve(struct trace* tr) {
+
+	int count = (MRC_HI - MRC_LO) / MRC_STEP + 1;
+	size_t n;
+	struct inst* insts = loadTrace(tr, &n);
+	struct sim* sims[count];
+
+	for(int i = 0; i < count; i++) {
+		sims[i] = createSim(tr->layout, PAGERS[0], MRC_LO + i * MRC_STEP);
+		freeOutbuf(sims[i]->out);
+		sims[i]->out = createOutbuf(-1, false);
+	}
+
+	runSims(sims, count, insts, n);
+
+	for(int i = 0; i < count; i++) {
+		struct pstat_t total = { 0 };
+		for(int j = 0; j < tr->layout->procCount; j++) {
+			struct pstat_t* pstat = sims[i]->procArray[j].pstat;
+			total.unmaps += pstat->unmaps;
+			total.maps += pstat->maps;
+			total.ins += pstat->ins;
+			total.outs += pstat->outs;
+			total.fins += pstat->fins;
+			total.fouts += pstat->fouts;
+			total.zeros += pstat->zeros;
+			total.segv += pstat->segv;
+			total.segprot += pstat->segprot;
+		}
+
+		printCurvePoint(sims[i]->num_frames, &total, sims[i]->instCount - sims[i]->ctxSwitches,
+			sims[i]->cost + tlbCost(sims[i]) + readaheadCost(sims[i]) + shareCost(sims[i]) + numaCost(sims[i]));
+		freeSim(sims[i]);
+	}
+
+	free(insts);
+}
+
+// baseCost is the context switch and per-reference cost already charged by the run
+void printCurvePoint(int frames, struct pstat_t* total, unsigned long refs, unsigned long baseCost) {
+
+	printf("MRC %d %lu %.6f %lu\n", frames, total->maps, refs ? (double) total->maps / refs : 0.0,
+		baseCost + pstatCost(total));
+}
+
+/*
+	Replay one decoded trace through every sim, using one thread per online
+	cpu. Threads pull the next sim off a shared counter until none are left.
+*/
+void runSims(struct sim** sims, int count, const struct inst* insts, size_t n) {
+
+	struct pool pool = { sims, count, 0, PTHREAD_MUTEX_INITIALIZER, insts, n, NULL, NULL };
+	runPool(&pool);
+}
+
+// each sim its own instructions, parts[i] of length lens[i]
+void runSimParts(struct sim** sims, int count, struct inst** parts, size_t* lens) {
+
+	struct pool pool = { sims, count, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0, parts, lens };
+	runPool(&pool);
+}
+
+void runPool(struct pool* pool) {
+
+	int nthreads = poolThreads(pool->count);
+	pthread_t threads[nthreads];
+
+	for(int i = 0; i < nthreads; i++) {
+		if(pthread_create(&threads[i], NULL, runSimThread, pool) != 0) {
+			printf("Error: Could not start simulation thread\n");
+			exit(1);
+		}
+	}
+
+	for(int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+// -j threads, or one per online cpu, but no more than there is work for
+int poolThreads(int count) {
+
+	long cpus = THREADS ? THREADS : sysconf(_SC_NPROCESSORS_ONLN);
+	return (cpus < 1) ? 1 : (cpus < count ? (int) cpus : count);
+}
+
+void* runSimThread(void* arg) {
+
+	struct pool* pool = (struct pool*) arg;
+
+	while(true) {
+		pthread_mutex_lock(&pool->lock);
+		int i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if(i >= pool->count) {
+			return NULL;
+		}
+		if(pool->parts) {
+			runSimulation(pool->sims[i], pool->parts[i], pool->partLens[i]);
+		} else {
+			runSimulation(pool->sims[i], pool->insts, pool->n);
+		}
+	}
+}
+
+/*
+	-b listfile runs every trace named in listfile, one path per line, with
+	the same pagers, frames and options. Traces are independent, so each gets
+	its own layout and sims and -j threads pull the next trace off a shared
+	counter. A trace's output goes to <trace>.out, exactly what a single run
+	would print; the pagers of one trace run one after another on its thread.
+*/
+void runBatch(char* listfile) {
+
+	FILE* fp = fopen(listfile, "r");
+	if(!fp) {
+		printf("Error: Could not open batch list\n");
+		exit(1);
+	}
+
+	struct batch batch = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+	int cap = 0;
+	char line[4096];
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if(line[0] == '\0') {
+			continue;
+		}
+		if(batch.count == cap) {
+			cap = cap ? 2 * cap : 16;
+			batch.traces = (char**) realloc(batch.traces, sizeof(char*) * cap);
+		}
+		batch.traces[batch.count++] = strdup(line);
+	}
+	fclose(fp);
+
+	if(strlen(PAGERS) > 1) {
+		PRINT_SUM = true;
+	}
+
+	int nthreads = poolThreads(batch.count);
+	pthread_t threads[nthreads > 0 ? nthreads : 1];
+
+	for(int i = 0; i < nthreads; i++) {
+		if(pthread_create(&threads[i], NULL, runBatchThread, &batch) != 0) {
+			printf("Error: Could not start simulation thread\n");
+			exit(1);
+		}
+	}
+
+	for(int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for(int i = 0; i < batch.count; i++) {
+		free(batch.traces[i]);
+	}
+	free(batch.traces);
+}
+
+void* runBatchThread(void* arg) {
+
+	struct batch* batch = (struct batch*) arg;
+
+	while(true) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+
+		if(i >= batch->count) {
+			return NULL;
+		}
+		runBatchTrace(batch->traces[i]);
+	}
+}
+
+void runBatchTrace(char* filename) {
+
+	struct trace* tr = openTrace(filename);
+	if(!tr) {
+		printf("Error: Could not open input file %s\n", filename);
+		return;
+	}
+	createProcArray(tr);
+
+	char outname[strlen(filename) + 5];
+	sprintf(outname, "%s.out", filename);
+	int fd = open(outname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		printf("Error: Could not open output file %s\n", outname);
+		closeTrace(tr);
+		return;
+	}
+
+	// several pagers replay one decoded buffer, a lone online pager streams
+	int count = strlen(PAGERS);
+	bool whole = count > 1 || strchr(OFFLINE_PAGERS, PAGERS[0]);
+	size_t n = 0;
+	struct inst* insts = whole ? loadTrace(tr, &n) : (struct inst*) malloc(sizeof(struct inst) * INST_CHUNK);
+
+	for(int i = 0; i < count; i++) {
+		struct sim* sim = createSim(tr->layout, PAGERS[i], NUM_FRAMES);
+		freeOutbuf(sim->out);
+		sim->out = createOutbuf(fd, false);
+		if(count > 1) {
+			out_printf(sim->out, "PAGER %c\n", PAGERS[i]);
+		}
+
+		if(whole) {
+			runSimulation(sim, insts, n);
+		} else {
+			while((n = read_instructions(tr, insts, INST_CHUNK)) > 0) {
+				runSimulation(sim, insts, n);
+			}
+		}
+
+		finishSim(sim);
+		freeSim(sim);
+	}
+
+	close(fd);
+	free(insts);
+	closeTrace(tr);
+}
+
+void finishSim(struct sim* sim) {
+
+	if(PRINT_PTE) printPageTables(sim);
+	if(PRINT_FT) printFrameTable(sim);
+	if(PRINT_SUM) printStats(sim);
+	out_flush(sim->out);
+}
+
+
+struct sim* createSim(const struct layout* layout, char pager, int num_frames) {
+
+	struct sim* sim = (struct sim*) malloc(sizeof(struct sim));
+	sim->layout = layout;
+	sim->pager = pager;
+	sim->num_frames = num_frames;
+	sim->procArray = createSimProcArray(layout);
+	sim->current = NULL;
+	sim->frametable = createFrameTable(num_frames);
+	sim->freeFrame = 0;
+	sim->freeList = KSWAPD_LOW ? (int*) malloc(sizeof(int) * num_frames) : NULL;
+	sim->freeCount = 0;
+	sim->frameLimit = num_frames;
+	sim->pffRefs = sim->pffFaults = 0;
+	sim->numa = createNodes(sim->frametable, num_frames);
+	sim->victimLo = 0;
+	sim->victimHi = num_frames;
+	sim->localRefs = sim->remoteRefs = sim->fallbacks = 0;
+	sim->freebits = createBitmap(num_frames);
+	sim->frameInd = 0;
+	sim->pagerOn = false;
+	sim->instCount = 0;
+	sim->ctxSwitches = 0;
+	sim->cost = 0;
+	sim->ofs = 0;
+	rng_seed(&sim->rng, RAND_SEED);
+	sim->requests = 0;
+	sim->clockHand = 0;
+	sim->lruHead = sim->lruTail = -1;
+	sim->optHeap = NULL;
+	sim->optHeapPos = NULL;
+	sim->optKey = NULL;
+	sim->optHeapSize = 0;
+	sim->ages = (pager == 'a') ? createAges(num_frames) : NULL;
+	sim->lastUse = (pager == 'w' || pager == 'W') ? (unsigned long*) calloc(num_frames, sizeof(unsigned long)) : NULL;
+	sim->hist = NULL;
+	sim->frameEntry = NULL;
+	if(strchr(HISTORY_PAGERS, pager)) {
+		// resident pages plus at most as many ghosts, and the entries of a fault in flight
+		sim->hist = createHistory(2 * num_frames + 2);
+		sim->frameEntry = (int*) malloc(sizeof(int) * num_frames);
+	}
+	sim->faultEntry = -1;
+	sim->target = (pager == 'P') ? 1 : 0;
+	sim->arcDiscard = false;
+	sim->handHot = sim->handCold = sim->handTest = -1;
+	sim->countHot = sim->countCold = sim->countTest = 0;
+	sim->ghostHits = 0;
+	if(pager == 'o') {
+		sim->optHeap = (int*) malloc(sizeof(int) * num_frames);
+		sim->optHeapPos = (int*) malloc(sizeof(int) * num_frames);
+		sim->optKey = (size_t*) malloc(sizeof(size_t) * num_frames);
+		for(int i = 0; i < num_frames; i++) {
+			sim->optHeapPos[i] = -1;
+		}
+	}
+	sim->refbits = createBitmap(num_frames);
+	sim->modbits = createBitmap(num_frames);
+	sim->tlb = TLB_ENTRIES ? createTlb() : NULL;
+	sim->faults = 0;
+	sim->hugeMaps = 0;
+	sim->splits = 0;
+	sim->collapses = 0;
+	sim->popPid = -1;
+	sim->popBase = sim->popSize = 0;
+	sim->popAborted = false;
+	sim->reclaiming = false;
+	sim->kswapdWakeups = 0;
+	sim->directReclaims = 0;
+	sim->raPages = sim->raHits = sim->raWasted = 0;
+	sim->rmap = NULL;
+	sim->rmapCap = 0;
+	sim->rmapFree = -1;
+	sim->objects = layout->sharing ? createPageMap() : NULL;
+	sim->objPages = NULL;
+	sim->objCount = sim->objCap = 0;
+	sim->faultObj = -1;
+	sim->shareMaps = sim->cowCopies = sim->cowReuses = 0;
+	sim->sharedPtes = sim->sharedPeak = 0;
+	sim->nextSnap = SNAP_INTERVAL;
+	sim->snapBase = SNAP_INTERVAL ? (struct pstat_t*) calloc(layout->procCount, sizeof(struct pstat_t)) : NULL;
+	sim->ckptWriter = 0;
+	memset(&sim->kswapdStat, 0, sizeof(struct pstat_t));
+	sim->out = createOutbuf(STDOUT_FILENO, false);
+	sim->log = NULL;
+	return sim;
+}
+
+void freeSim(struct sim* sim) {
+
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		freePageTable(sim->procArray[i].pagetable, sim->layout->ptLevels);
+		free(sim->procArray[i].pstat);
+		free(sim->procArray[i].ra);
+	}
+	free(sim->procArray);
+	free(sim->snapBase);
+	free(sim->frametable);
+	free(sim->freeList);
+	free(sim->numa);
+	free(sim->freebits);
+	free(sim->optHeap);
+	free(sim->optHeapPos);
+	free(sim->optKey);
+	free(sim->ages);
+	free(sim->lastUse);
+	if(sim->hist) {
+		freeHistory(sim->hist);
+	}
+	free(sim->frameEntry);
+	free(sim->rmap);
+	if(sim->objects) {
+		freePageMap(sim->objects);
+	}
+	free(sim->objPages);
+	free(sim->refbits);
+	free(sim->modbits);
+	if(sim->tlb) {
+		freeTlb(sim->tlb);
+	}
+	if(sim->log) {
+		out_byte(sim->log, (OP_ESCAPE << OP_SHIFT) | ESC_END);
+		freeOutbuf(sim->log);
+	}
+	freeOutbuf(sim->out);
+	free(sim);
+}
+
+
+void runSimulation(struct sim* sim, const struct inst* insts, size_t count) {
+
+	for(size_t i = 0; i < count; i++) {
+
+		char operation = insts[i].op;
+		unsigned long curr_vpage = insts[i].vpage;
+		struct process* proc = sim->current;
+
+		if(KHUGEPAGED && sim->instCount && sim->instCount % KHUGEPAGED == 0) {
+			khugepaged_scan(sim);
+		}
+
+		if(KSWAPD_LOW && sim->freeCount < KSWAPD_LOW && sim->freeFrame == sim->num_frames) {
+			kswapd(sim);
+		}
+
+		if(sim->instCount == sim->nextSnap && SNAP_INTERVAL) {
+			printSnapshot(sim);
+		}
+
+		if(PRINT_INSTR) log_inst(sim, operation, curr_vpage);
+
+		if(operation == 'c') {
+			if(sim->tlb && !TLB_ASID && sim->current != &(sim->procArray[curr_vpage])) {
+				tlb_flush(sim->tlb);
+			}
+			sim->current = &(sim->procArray[curr_vpage]);
+			sim->instCount++;
+			sim->ctxSwitches++;
+			sim->cost += 121;
+			continue;
+		}
+
+		sim->cost++;
+		proc->vtime++;
+		struct pte_t* pte = translate(sim, proc, curr_vpage);
+		struct vma_t* vma = NULL;
+
+		if(!pte || !pte->present) {
+
+			if(!(vma = find_vma(proc, curr_vpage))) {
+				if(PRINT_INSTR) log_event(sim, EV_SEGV, 0, 0);
+				proc->pstat->segv++;
+				sim->instCount++;
+				continue;
+			}
+			// page table levels are only allocated for pages inside a vma
+			if(!pte) {
+				pte = lookup_pte(proc, curr_vpage, true);
+			}
+
+			// a huge mapping can lose the faulting page again if populating it needed reclaim
+			sim->faults++;
+			if(vma->shared || (vma->cow && !pte->cowed)) {
+				map_shared(sim, proc, curr_vpage, vma, pte);
+			} else if(!map_huge(sim, proc, curr_vpage, vma) || !pte->present) {
+				if(READAHEAD_MAX) readahead(sim, proc, curr_vpage, vma, pte);
+				map_page(sim, proc, curr_vpage, vma, pte);
+			}
+
+			if(sim->tlb) {
+				tlb_fill_pte(sim, proc, curr_vpage, pte);
+			}
+		}
+
+		// a write to a COW page still shared gets the process its own copy first
+		if(operation == 'w' && pte->shared && !pte->write_protect) {
+			vma = vma ? vma : find_vma(proc, curr_vpage);
+			if(vma->cow) {
+				cow_break(sim, proc, curr_vpage, vma, pte);
+			}
+		}
+
+		if(pte->prefetched) {
+			pte->prefetched = 0;
+			sim->raHits++;
+		}
+
+		// pagers see a shared frame's R and M bits through the pte the frame records
+		struct pte_t* first = pte->shared ? sim->frametable[pte->frame].pte : pte;
+
+		if(NUMA_NODES > 1) {
+			if(sim->frametable[pte->frame].node == proc->home) {
+				sim->localRefs++;
+			} else {
+				sim->remoteRefs++;
+			}
+		}
+
+		pte->referenced = 1; // set to 1 for any r/w operation
+		first->referenced = 1;
+		set_bit(sim->refbits, pte->frame);
+		pager_referenced(sim, pte->frame);
+		// if op is a write but write_protect is set for pte, issue segprot. Otherise, set modified to 1 
+		if(operation == 'w') {
+			if(pte->write_protect) {
+				log_event(sim, EV_SEGPROT, 0, 0);
+				proc->pstat->segprot++;
+			} else {
+				pte->modified = 1;
+				first->modified = 1;
+				set_bit(sim->modbits, pte->frame);
+			}
+		}
+
+		sim->instCount++;
+	}
+}
+
+// TLB probe (base entry, then any huge entry of the process), falling back to the page table walk
+struct pte_t* translate(struct sim* sim, struct process* proc, unsigned long vpage) {
+
+	struct tlb* tlb = sim->tlb;
+	struct pte_t* pte = NULL;
+
+	if(!tlb) {
+		return lookup_pte(proc, vpage, false);
+	}
+
+	// a hit is always a present page, unmapping shoots its entry down
+	if(tlb_lookup(tlb, vpage, tlb_key(proc->pid, vpage), &pte)) {
+		tlb->hits++;
+		return pte;
+	}
+	for(int h = 1; h < 3; h++) {
+		if((proc->hugeClasses & (1U << h)) &&
+		   tlb_lookup(tlb, vpage >> HUGE_SHIFT[h], tlb_huge_key(proc->pid, vpage, h), &pte)) {
+			tlb->hits++;
+			return lookup_pte(proc, vpage, false);
+		}
+	}
+
+	tlb->misses++;
+	pte = lookup_pte(proc, vpage, false);
+	if(pte && pte->present) {
+		tlb_fill_pte(sim, proc, vpage, pte);
+	}
+	return pte;
+}
+
+// give vpage a frame, reclaiming one if there are no free frames left
+struct frame_t* map_page(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte) {
+
+	struct frame_t* newframe = install_page(sim, proc, vpage, vma, pte);
+
+	if(pte->pagedout) {
+		if(pte->filemapped) {
+			if(PRINT_INSTR) log_event(sim, EV_FIN, 0, 0);
+			proc->pstat->fins++;
+		} else {
+			if(PRINT_INSTR) log_event(sim, EV_IN, 0, 0);
+			proc->pstat->ins++;
+		}
+
+	} else {
+		if(pte->filemapped) {
+			if(PRINT_INSTR) log_event(sim, EV_FIN, 0, 0);
+			proc->pstat->fins++;
+		} else {
+			if(PRINT_INSTR) log_event(sim, EV_ZERO, 0, 0);
+			proc->pstat->zeros++;
+		}
+	}
+
+	if(PRINT_INSTR) log_event(sim, EV_MAP, pte->frame, 0);
+	proc->pstat->maps++;
+
+	return newframe;
+}
+
+// frame, pte and pager setup of a mapping, without the I/O accounting
+struct frame_t* install_page(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte) {
+
+	// get victim frame and reset its proc,vpage entry
+	int obj = sim->faultObj;
+	sim->faultObj = -1;
+	pager_fault(sim, (obj == -1) ? page_key(proc->pid, vpage) : OBJECT_KEY | obj);
+	struct frame_t* newframe = get_frame(sim, place_node(sim, proc, vpage));
+
+	// free frames, never used or reclaimed by kswapd, hold no page
+	if(newframe->pte) {
+		unmap_frame(sim, newframe);
+	}
+
+	pte->present = 1; // we are giving this page a frame in memory so present is set to 1
+	pte->write_protect = vma->write_protect;
+	pte->filemapped = vma->filemapped && !pte->cowed; // a COW copy is anonymous
+	pte->frame = newframe->fid; // assign victim frame to pte
+	newframe->pid = proc->pid; // set reverse mapping vals for newframe
+	newframe->vpage = vpage;
+	newframe->pte = pte;
+	newframe->mapcount = 1;
+	newframe->rmap = -1;
+	newframe->objpage = obj;
+	pte->modified = 0;
+	pte->referenced = 0;
+	clear_bit(sim->modbits, newframe->fid);
+	clear_bit(sim->refbits, newframe->fid);
+	if(sim->lastUse) {
+		sim->lastUse[newframe->fid] = proc->vtime;
+	}
+	pager_admit(sim, newframe->fid);
+
+	return newframe;
+}
+
+/*
+	Readahead (-R max), after Linux's ondemand readahead. Each vma keeps a
+	window: major faults on two consecutive pages start a sequential stream
+	with a small window, and a fault on the first page past the window, where
+	a stream that used all of it faults next, grows the window 4x while it is
+	small and 2x up to max. Any other fault ends the stream. The rest of the
+	window is mapped before the faulting page, as one batched read: pages
+	that would be read in (filemapped or paged out) and are not resident get
+	a frame for the map cost plus READAHEAD_IO_COST. They count as hits when
+	first referenced and as waste if evicted before that. Mapping stops if
+	reclaim takes a page of the window. OPT, keyed by references, does not
+	read ahead.
+*/
+void readahead(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte) {
+
+	// only a fault that reads its page in has a read to batch; object pages are not read ahead
+	if((!vma->filemapped && !pte->pagedout) || vma->cow || strchr(OFFLINE_PAGERS, sim->pager)) {
+		return;
+	}
+
+	struct readahead* ra = &proc->ra[vma->id];
+	if(ra->size && vpage == ra->next) {
+		ra->size = readahead_next_size(ra->size, READAHEAD_MAX);
+	} else if(ra->after && vpage == ra->after) {
+		ra->size = readahead_init_size(READAHEAD_MAX);
+	} else {
+		ra->size = 0;
+	}
+	ra->after = vpage + 1;
+	if(!ra->size) {
+		return;
+	}
+	ra->next = vpage + ra->size;
+
+	unsigned long last = (ra->next - 1 < vma->end_vpage) ? ra->next - 1 : vma->end_vpage;
+	sim->popPid = proc->pid;
+	sim->popBase = vpage + 1;
+	sim->popSize = last - vpage;
+	sim->popAborted = false;
+
+	for(unsigned long v = vpage + 1; v <= last && !sim->popAborted; v++) {
+		struct pte_t* next = lookup_pte(proc, v, true);
+		if(next->present || (!vma->filemapped && !next->pagedout)) {
+			continue;
+		}
+		struct frame_t* frame = install_page(sim, proc, v, vma, next);
+		pager_mapped(sim, frame->fid);
+		next->prefetched = 1;
+		sim->raPages++;
+		if(PRINT_INSTR) log_event(sim, EV_READAHEAD, v, frame->fid);
+	}
+
+	sim->popPid = -1;
+}
+
+// first window of a stream, as Linux sizes one for a single page read
+unsigned long readahead_init_size(unsigned long max) {
+
+	if(max >= 32) {
+		return 4;
+	}
+	return (max >= 4) ? 2 : max;
+}
+
+unsigned long readahead_next_size(unsigned long size, unsigned long max) {
+
+	if(size < max / 16) {
+		return 4 * size;
+	}
+	return (size <= max / 2) ? 2 * size : max;
+}
+
+// evict the page in frame, splitting the huge mapping it belongs to first
+void unmap_frame(struct sim* sim, struct frame_t* frame) {
+
+	if(PRINT_INSTR) log_event(sim, EV_UNMAP, frame->pid, frame->vpage);
+
+	struct process* oldProc = &(sim->procArray[frame->pid]);
+	struct pstat_t* pstat = sim->reclaiming ? &sim->kswapdStat : oldProc->pstat;
+	pstat->unmaps++;
+	struct pte_t* oldPTE = frame->pte;
+	if(oldPTE->prefetched) {
+		oldPTE->prefetched = 0;
+		sim->raWasted++;
+	}
+
+	if(oldPTE->huge) {
+		split_huge(sim, oldProc, frame->vpage, oldPTE);
+	}
+	if((int) frame->pid == sim->popPid && frame->vpage - sim->popBase < sim->popSize) {
+		sim->popAborted = true;
+	}
+
+	oldPTE->present = 0;
+	if(sim->tlb) {
+		tlb_invalidate(sim->tlb, frame->vpage, tlb_key(frame->pid, frame->vpage));
+	}
+	if(frame->objpage != -1) {
+		unmap_sharers(sim, frame);
+	}
+
+	// if page was modified, we have page out to disk (swap device) or re-map to file
+	if(oldPTE->modified) {
+		if(oldPTE->filemapped) {
+			if(PRINT_INSTR) log_event(sim, EV_FOUT, 0, 0);
+			pstat->fouts++;
+		} else {
+			if(PRINT_INSTR) log_event(sim, EV_OUT, 0, 0);
+			pstat->outs++;
+			oldPTE->pagedout = 1;
+		}
+	}
+}
+
+/*
+	Shared pages. A shared or COW vma maps an object by id, and each page of
+	it is the object's page at the same offset into the vma, whichever
+	process and address maps it. The first fault on an object page brings it
+	in like a private page. Faults by other processes while it is resident
+	only add their pte to the frame's reverse map, for a map and no I/O.
+	Evicting the frame unmaps it from every pte and writes it back once.
+*/
+void map_shared(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte) {
+
+	int obj = object_page(sim, vma, vpage);
+	int fid = sim->objPages[obj].frame;
+	pte->shared = 1;
+
+	if(fid == -1) {
+		pte->pagedout = sim->objPages[obj].pagedout;
+		sim->faultObj = obj;
+		sim->objPages[obj].frame = map_page(sim, proc, vpage, vma, pte)->fid;
+		return;
+	}
+
+	pte->present = 1;
+	pte->write_protect = vma->write_protect;
+	pte->filemapped = vma->filemapped;
+	pte->frame = fid;
+	pte->modified = 0;
+	pte->referenced = 0;
+	rmap_add(sim, &sim->frametable[fid], proc->pid, vpage, pte);
+	sim->shareMaps++;
+
+	if(PRINT_INSTR) log_event(sim, EV_SHARE, fid, 0);
+	proc->pstat->maps++;
+}
+
+/*
+	Write to a COW page still shared through its object: the writer gets a
+	private copy in a frame of its own, for a map plus COW_COPY_COST, and
+	leaves the shared frame to the other ptes. If no other pte maps the
+	page the writer keeps the frame, as Linux reuses a page mapped once, and
+	the object is left without it; a later fault finds the page as it was
+	before any process touched it.
+*/
+void cow_break(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma, struct pte_t* pte) {
+
+	struct frame_t* frame = &sim->frametable[pte->frame];
+	pte->shared = 0;
+	pte->cowed = 1;
+
+	if(frame->mapcount == 1) {
+		sim->objPages[frame->objpage].frame = -1;
+		frame->objpage = -1;
+		pte->filemapped = 0;
+		if(sim->hist) {
+			hist_rekey(sim->hist, sim->frameEntry[frame->fid], frame_key(sim, frame));
+		}
+		sim->cowReuses++;
+		return;
+	}
+
+	rmap_remove(sim, frame, pte);
+	pte->present = 0;
+	if(sim->tlb) {
+		tlb_invalidate(sim->tlb, vpage, tlb_key(proc->pid, vpage));
+	}
+
+	struct frame_t* copy = install_page(sim, proc, vpage, vma, pte);
+	sim->cowCopies++;
+	if(PRINT_INSTR) log_event(sim, EV_COW, copy->fid, 0);
+	proc->pstat->maps++;
+
+	if(sim->tlb) {
+		tlb_fill_pte(sim, proc, vpage, pte);
+	}
+}
+
+// index of vma's object page at vpage, added as not resident the first time
+int object_page(struct sim* sim, struct vma_t* vma, unsigned long vpage) {
+
+	int i = pagemap_index(sim->objects, vma->obj, vpage - vma->start_vpage);
+	if(i < sim->objCount) {
+		return i;
+	}
+
+	if(sim->objCount == sim->objCap) {
+		sim->objCap = sim->objCap ? 2 * sim->objCap : 1024;
+		sim->objPages = (struct objpage*) realloc(sim->objPages, sizeof(struct objpage) * sim->objCap);
+		if(!sim->objPages) {
+			printf("Error: Out of memory tracking shared pages\n");
+			exit(1);
+		}
+	}
+	sim->objPages[i].frame = -1;
+	sim->objPages[i].pagedout = false;
+	sim->objCount++;
+	return i;
+}
+
+void rmap_add(struct sim* sim, struct frame_t* frame, unsigned int pid, unsigned long vpage, struct pte_t* pte) {
+
+	if(sim->rmapFree == -1) {
+		int cap = sim->rmapCap ? 2 * sim->rmapCap : 256;
+		sim->rmap = (struct rmap_t*) realloc(sim->rmap, sizeof(struct rmap_t) * cap);
+		if(!sim->rmap) {
+			printf("Error: Out of memory tracking shared pages\n");
+			exit(1);
+		}
+		for(int i = sim->rmapCap; i < cap; i++) {
+			sim->rmap[i].next = (i + 1 < cap) ? i + 1 : -1;
+		}
+		sim->rmapFree = sim->rmapCap;
+		sim->rmapCap = cap;
+	}
+
+	int e = sim->rmapFree;
+	struct rmap_t* r = &sim->rmap[e];
+	sim->rmapFree = r->next;
+	r->pid = pid;
+	r->vpage = vpage;
+	r->pte = pte;
+	r->next = frame->rmap;
+	frame->rmap = e;
+	frame->mapcount++;
+
+	if(++sim->sharedPtes > sim->sharedPeak) {
+		sim->sharedPeak = sim->sharedPtes;
+	}
+}
+
+// drop pte's mapping of a shared frame; if the frame records it, the next mapping takes its place and the frame's R and M bits
+void rmap_remove(struct sim* sim, struct frame_t* frame, struct pte_t* pte) {
+
+	int* p = &frame->rmap;
+	if(frame->pte == pte) {
+		struct rmap_t* r = &sim->rmap[*p];
+		r->pte->referenced = pte->referenced;
+		r->pte->modified = pte->modified;
+		frame->pid = r->pid;
+		frame->vpage = r->vpage;
+		frame->pte = r->pte;
+	} else {
+		while(sim->rmap[*p].pte != pte) {
+			p = &sim->rmap[*p].next;
+		}
+	}
+
+	int e = *p;
+	*p = sim->rmap[e].next;
+	sim->rmap[e].next = sim->rmapFree;
+	sim->rmapFree = e;
+	frame->mapcount--;
+	sim->sharedPtes--;
+}
+
+// unmap an object page being evicted from the ptes besides frame->pte, which unmap_frame handles
+void unmap_sharers(struct sim* sim, struct frame_t* frame) {
+
+	bool out = frame->pte->modified && !frame->pte->filemapped;
+
+	for(int e = frame->rmap; e != -1; ) {
+		struct rmap_t* r = &sim->rmap[e];
+		if(PRINT_INSTR) log_event(sim, EV_UNMAP, r->pid, r->vpage);
+		(sim->reclaiming ? &sim->kswapdStat : sim->procArray[r->pid].pstat)->unmaps++;
+		r->pte->present = 0;
+		r->pte->pagedout |= out;
+		if(sim->tlb) {
+			tlb_invalidate(sim->tlb, r->vpage, tlb_key(r->pid, r->vpage));
+		}
+
+		int next = r->next;
+		r->next = sim->rmapFree;
+		sim->rmapFree = e;
+		sim->sharedPtes--;
+		e = next;
+	}
+
+	struct objpage* page = &sim->objPages[frame->objpage];
+	page->frame = -1;
+	page->pagedout |= out;
+	frame->mapcount = 1;
+	frame->rmap = -1;
+	frame->objpage = -1;
+}
+
+// the history key of the page in frame: its object page if it has one, else its owner's (pid, vpage)
+unsigned long frame_key(struct sim* sim, struct frame_t* frame) {
+
+	return (frame->objpage == -1) ? page_key(frame->pid, frame->vpage) : OBJECT_KEY | frame->objpage;
+}
+
+/*
+	Background reclaim (-d low:high), after kswapd. Once memory has filled,
+	whenever fewer than low frames are free before an instruction the pager
+	picks victims until high are free, at most all but one frame. Their
+	unmaps and writebacks are background I/O: they are counted apart from the
+	faults' own, in the KSWAPD summary line, and left out of TOTALCOST, so
+	a fault that finds a free frame pays only for bringing its page in.
+*/
+void kswapd(struct sim* sim) {
+
+	int high = (KSWAPD_HIGH < sim->num_frames) ? KSWAPD_HIGH : sim->num_frames - 1;
+	if(sim->freeCount >= high) {
+		return;
+	}
+
+	if(PRINT_INSTR) log_event(sim, EV_KSWAPD, sim->freeCount, 0);
+	sim->kswapdWakeups++;
+	sim->reclaiming = true;
+
+	while(sim->freeCount < high) {
+		sim->requests++;
+		struct frame_t* frame = select_victim_frame(sim);
+		unmap_frame(sim, frame);
+		release_frame(sim, frame);
+	}
+
+	sim->reclaiming = false;
+}
+
+// -L pff took frames away: reclaim the sim's own pages down to its new limit
+void shrink_frames(struct sim* sim) {
+
+	while(sim->freeFrame - sim->freeCount > sim->frameLimit) {
+		sim->requests++;
+		struct frame_t* frame = select_victim_frame(sim);
+		unmap_frame(sim, frame);
+		release_frame(sim, frame);
+	}
+}
+
+// put an unmapped frame on the free list, out of its pager's reach
+void release_frame(struct sim* sim, struct frame_t* frame) {
+
+	int fid = frame->fid;
+	pager_release(sim, fid);
+	frame->pid = UINT_MAX;
+	frame->vpage = ULONG_MAX;
+	frame->pte = NULL;
+	clear_bit(sim->refbits, fid);
+	clear_bit(sim->modbits, fid);
+	set_bit(sim->freebits, fid);
+	struct numa_node* node = &sim->numa[frame->node];
+	sim->freeList[node->lo + node->freeCount++] = fid;
+	sim->freeCount++;
+}
+
+
+/*
+	Huge pages. A fault in a huge vma maps the whole aligned huge range around
+	the page at once if the range lies inside the vma, none of it is resident
+	and it fits in memory; otherwise, and in khugepaged mode, it maps a single
+	page. Each page of the range still has its own frame and pte, so pagers
+	work on base pages as before, but the range needs one fault and one TLB
+	entry. Reclaiming any page of a huge range splits it back to base pages.
+	OPT keys frames by the next reference of the faulting page only, so it
+	never maps huge.
+*/
+bool map_huge(struct sim* sim, struct process* proc, unsigned long vpage, struct vma_t* vma) {
+
+	if(!vma->huge || KHUGEPAGED || strchr(OFFLINE_PAGERS, sim->pager)) {
+		return false;
+	}
+
+	unsigned long size = HUGE_PAGES[vma->huge];
+	unsigned long base = vpage & ~(size - 1);
+	if(size > (unsigned long) sim->frameLimit || base < vma->start_vpage || base + size - 1 > vma->end_vpage) {
+		return false;
+	}
+
+	for(unsigned long v = base; v < base + size; v++) {
+		struct pte_t* pte = lookup_pte(proc, v, false);
+		if(!pte) {
+			v |= PT_FANOUT - 1; // no leaf, nothing resident under it
+		} else if(pte->present) {
+			return false;
+		}
+	}
+
+	populate_huge(sim, proc, vma, base, vpage);
+	return true;
+}
+
+/*
+	Map every missing page of the huge range at base, first the one at first,
+	and mark the range huge if it ends up fully resident. Population stops if
+	reclaim takes one of the range's own pages. Returns whether it went huge.
+*/
+bool populate_huge(struct sim* sim, struct process* proc, struct vma_t* vma, unsigned long base, unsigned long first) {
+
+	unsigned long size = HUGE_PAGES[vma->huge];
+	sim->popPid = proc->pid;
+	sim->popBase = base;
+	sim->popSize = size;
+	sim->popAborted = false;
+
+	// first, then the rest of the range in order
+	for(unsigned long n = 0; n <= size && !sim->popAborted; n++) {
+		unsigned long v = (n == 0) ? first : base + n - 1;
+		if(n > 0 && v == first) {
+			continue;
+		}
+		struct pte_t* pte = lookup_pte(proc, v, true);
+		if(!pte->present) {
+			struct frame_t* frame = map_page(sim, proc, v, vma, pte);
+			if(v != first) {
+				pager_mapped(sim, frame->fid);
+			}
+		}
+	}
+
+	bool huge = !sim->popAborted;
+	sim->popPid = -1;
+	if(!huge) {
+		return false;
+	}
+
+	for(unsigned long v = base; v < base + size; v++) {
+		lookup_pte(proc, v, false)->huge = vma->huge;
+	}
+	if(PRINT_INSTR) log_event(sim, EV_HUGE, proc->pid, base);
+	sim->hugeMaps++;
+	return true;
+}
+
+// vpage's huge range goes back to base pages and loses its TLB entry
+void split_huge(struct sim* sim, struct process* proc, unsigned long vpage, struct pte_t* pte) {
+
+	int h = pte->huge;
+	unsigned long size = HUGE_PAGES[h];
+	unsigned long base = vpage & ~(size - 1);
+
+	for(unsigned long v = base; v < base + size; v++) {
+		lookup_pte(proc, v, false)->huge = 0;
+	}
+	if(sim->tlb) {
+		tlb_invalidate(sim->tlb, vpage >> HUGE_SHIFT[h], tlb_huge_key(proc->pid, vpage, h));
+	}
+
+	if(PRINT_INSTR) log_event(sim, EV_SPLIT, proc->pid, base);
+	sim->splits++;
+}
+
+/*
+	khugepaged mode (-k N): faults in huge vmas map base pages, and every N
+	instructions each aligned range inside a huge vma is collapsed into a
+	huge page when at least half of its pages are resident and at least half
+	of those have their R bit set. Collapsing faults in the missing pages.
+*/
+void khugepaged_scan(struct sim* sim) {
+
+	if(strchr(OFFLINE_PAGERS, sim->pager)) {
+		return;
+	}
+
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		struct process* proc = &sim->procArray[i];
+		if(!proc->hugeClasses) {
+			continue;
+		}
+
+		for(struct node* h = proc->vma_list->head; h != NULL; h = h->next) {
+			struct vma_t* vma = (struct vma_t*) h->val;
+			unsigned long size = HUGE_PAGES[vma->huge];
+			if(!vma->huge || size > (unsigned long) sim->frameLimit) {
+				continue;
+			}
+
+			unsigned long base = (vma->start_vpage + size - 1) & ~(size - 1);
+			for(; base >= vma->start_vpage && base + size - 1 <= vma->end_vpage; base += size) {
+				unsigned long present = 0, referenced = 0;
+				bool huge = false;
+
+				for(unsigned long v = base; v < base + size && !huge; v++) {
+					struct pte_t* pte = lookup_pte(proc, v, false);
+					if(!pte) {
+						v |= PT_FANOUT - 1;
+					} else if(pte->present) {
+						huge = pte->huge;
+						present++;
+						referenced += pte->referenced;
+					}
+				}
+
+				if(!huge && present && 2 * present >= size && 2 * referenced >= present) {
+					if(PRINT_INSTR) log_event(sim, EV_COLLAPSE, proc->pid, base);
+					if(populate_huge(sim, proc, vma, base, base)) {
+						sim->collapses++;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+// a frame for a page that belongs on node, which reclaim takes from node itself
+struct frame_t* get_frame(struct sim* sim, int node) {
+
+	bool full = sim->freeFrame - sim->freeCount >= sim->frameLimit;
+	struct frame_t* frame = full ? NULL : allocate_frame_from_free_list(sim, node);
+	
+	// if no more free frames, call paging algorithm
+	if(frame == NULL) {
+		sim->pagerOn = true;
+		sim->requests++;
+		sim->directReclaims++;
+		frame = (NUMA_NODES > 1) ? select_victim_local(sim, node) : select_victim_frame(sim);
+	}
+
+	return frame;
+}
+
+// a free frame on node, or failing that on the nodes after it in turn; NULL if there are none
+struct frame_t* allocate_frame_from_free_list(struct sim* sim, int node) {
+
+	for(int i = 0; i < NUMA_NODES; i++) {
+		struct frame_t* frame = node_free_frame(sim, (node + i) % NUMA_NODES);
+		if(frame) {
+			sim->fallbacks += (i > 0);
+			return frame;
+		}
+	}
+	return NULL;
+}
+
+// frames never used come first, then those kswapd reclaimed
+struct frame_t* node_free_frame(struct sim* sim, int node) {
+
+	struct numa_node* n = &sim->numa[node];
+	if(n->next < n->hi) {
+		sim->freeFrame++;
+		return &sim->frametable[n->next++];
+	}
+	if(n->freeCount > 0) {
+		int fid = sim->freeList[n->lo + --n->freeCount];
+		sim->freeCount--;
+		clear_bit(sim->freebits, fid);
+		return &sim->frametable[fid];
+	}
+	return NULL;
+}
+
+/*
+	First touch puts a page on the home node of the process that faults it
+	in, as the kernel does for the cpu a thread runs on; interleave spreads
+	the pages of each vma across the nodes by vpage.
+*/
+int place_node(struct sim* sim, struct process* proc, unsigned long vpage) {
+
+	return (NUMA_POLICY == 'i') ? (int) (vpage % NUMA_NODES) : proc->home;
+}
+
+
+/* 	
+	virtual function C implementation for selecting paging algorithm to evict victim frame 
+*/
+struct frame_t* select_victim_frame(struct sim* sim) {
+	switch(sim->pager) {
+		case 'f':
+			return select_victim_frame_fifo(sim);
+			break;
+		case 's':
+			return select_victim_frame_second_chance(sim);
+			break;
+		case 'c':
+			return select_victim_frame_clock(sim);
+			break;
+		case 'r':
+			return select_victim_frame_random(sim);
+			break;
+		case 'n':
+			return select_victim_frame_nru(sim);
+			break;
+		case 'a':
+			return select_victim_frame_aging(sim);
+			break;
+		case 'l':
+			return select_victim_frame_lru(sim);
+			break;
+		case 'o':
+			return select_victim_frame_opt(sim);
+			break;
+		case 'w':
+			return select_victim_frame_ws(sim);
+			break;
+		case 'W':
+			return select_victim_frame_wsclock(sim);
+			break;
+		case 'A':
+			return select_victim_frame_arc(sim);
+			break;
+		case 'C':
+			return select_victim_frame_car(sim);
+			break;
+		case 'P':
+			return select_victim_frame_clockpro(sim);
+			break;
+		default:
+			printf("Illegal pager type\n");
+			exit(1);
+	}
+}
+
+/*
+	Victim on node only, for a fault whose page belongs there. The frame
+	indexed pagers restrict their scans to the node's frames, each node with
+	its own hands, and LRU takes the least recently used page on the node.
+	OPT, ARC, CAR and CLOCK-Pro keep one global order, so they fall back to
+	their global choice and the page goes wherever the victim was.
+*/
+struct frame_t* select_victim_local(struct sim* sim, int node) {
+
+	struct numa_node* n = &sim->numa[node];
+	int frameInd = sim->frameInd, clockHand = sim->clockHand;
+
+	sim->victimLo = n->lo;
+	sim->victimHi = n->hi;
+	sim->frameInd = n->frameInd;
+	sim->clockHand = n->clockHand;
+
+	struct frame_t* frame = select_victim_frame(sim);
+
+	n->frameInd = sim->frameInd;
+	n->clockHand = sim->clockHand;
+	sim->frameInd = frameInd;
+	sim->clockHand = clockHand;
+	sim->victimLo = 0;
+	sim->victimHi = sim->num_frames;
+
+	if(frame->node != node) {
+		sim->fallbacks++;
+	}
+	return frame;
+}
+
+
+struct frame_t* select_victim_frame_fifo(struct sim* sim) {
+
+	struct frame_t* frame;
+	do {
+		if(sim->frameInd == sim->victimHi) {
+			sim->frameInd = sim->victimLo;
+		}
+		frame = &sim->frametable[sim->frameInd++];
+	} while(frame->pte == NULL); // free frames are skipped
+
+	return frame;
+}
+
+
+struct frame_t* select_victim_frame_second_chance(struct sim* sim) {
+
+	int fid = clock_sweep(sim, sim->frameInd);
+	sim->frameInd = fid + 1;
+	return &sim->frametable[fid];
+}
+
+
+struct frame_t* select_victim_frame_clock(struct sim* sim) {
+
+	int fid = clock_sweep(sim, sim->clockHand);
+	sim->clockHand = fid + 1;
+	return &sim->frametable[fid];
+}
+
+/*
+	Hand sweep shared by second chance and clock: starting at hand, clear the
+	R bit of each referenced frame and stop at the first unreferenced one.
+	The R bitmap is read a word at a time, so a run of 64 referenced frames
+	costs one step plus clearing their ptes.
+*/
+int clock_sweep(struct sim* sim, int hand) {
+
+	for(;;) {
+		if(hand >= sim->victimHi) {
+			hand = sim->victimLo;
+		}
+
+		int w = hand / 64;
+		int valid = sim->victimHi - w * 64;
+		unsigned long mask = ~0UL << (hand % 64);
+		if(valid < 64) {
+			mask &= (1UL << valid) - 1;
+		}
+
+		unsigned long unref = ~sim->refbits[w] & ~sim->freebits[w] & mask;
+		if(unref) {
+			int bit = __builtin_ctzl(unref);
+			clear_referenced(sim, w, mask & ((1UL << bit) - 1));
+			return w * 64 + bit;
+		}
+
+		// every remaining frame in this word was referenced
+		clear_referenced(sim, w, mask);
+		hand = (w + 1) * 64;
+	}
+}
+
+
+struct frame_t* select_victim_frame_random(struct sim* sim) {
+
+	struct frame_t* frame;
+	do {
+		frame = &sim->frametable[sim->victimLo + myrandom(sim, sim->victimHi - sim->victimLo)];
+	} while(frame->pte == NULL);
+
+	return frame;
+}
+
+
+/*
+	NRU classes (2 * R + M) are word-wise combinations of the per-frame R and M
+	bitmaps, which runSimulation keeps in step with the ptes. Counting the
+	classes and locating the chosen frame are O(F/64) word operations, and
+	the victim is still the same random member of the lowest class, in frame
+	order, that the old per-fault class arrays produced.
+*/
+struct frame_t* select_victim_frame_nru(struct sim* sim) {
+
+	int from = sim->victimLo / 64, to = (sim->victimHi + 63) / 64;
+	int counts[4] = { 0, 0, 0, 0 };
+
+	for(int w = from; w < to; w++) {
+		for(int c = 0; c < 4; c++) {
+			counts[c] += __builtin_popcountl(nru_class(sim, c, w));
+		}
+	}
+
+	// select a random frame from lowest non-empty class
+	struct frame_t* victim = NULL;
+	for(int c = 0; c < 4 && !victim; c++) {
+		if(!counts[c]) {
+			continue;
+		}
+
+		int n = myrandom(sim, counts[c]);
+		for(int w = from; w < to; w++) {
+			unsigned long bits = nru_class(sim, c, w);
+			int inWord = __builtin_popcountl(bits);
+			if(n < inWord) {
+				victim = &sim->frametable[w * 64 + nth_set_bit(bits, n)];
+				break;
+			}
+			n -= inWord;
+		}
+	}
+
+	// reset referenced bit every 10th request
+	if((sim->requests % 10) == 0) {
+		int words = (sim->num_frames + 63) / 64;
+		for(int w = 0; w < words; w++) {
+			clear_referenced(sim, w, ~0UL);
+		}
+	}
+
+	return victim;
+}
+
+// frames of NRU class c in bitmap word w, masked to frames victim selection may take that hold a page
+unsigned long nru_class(struct sim* sim, int c, int w) {
+
+	unsigned long r = sim->refbits[w], m = sim->modbits[w];
+	unsigned long bits = ((c & 2) ? r : ~r) & ((c & 1) ? m : ~m) & ~sim->freebits[w];
+	int valid = sim->victimHi - w * 64;
+
+	if(w == sim->victimLo / 64) {
+		bits &= ~0UL << (sim->victimLo % 64);
+	}
+	return (valid >= 64) ? bits : bits & ((1UL << valid) - 1);
+}
+
+// index of the n-th (from 0) set bit of word
+int nth_set_bit(unsigned long word, int n) {
+
+	while(n--) {
+		word &= word - 1;
+	}
+	return __builtin_ctzl(word);
+}
+
+
+/*
+	Aging keeps one counter per frame in sim->ages beside the per-frame R
+	bitmap, so a fault is one sweep over two flat arrays: shift each counter
+	right, or the frame's R bit in at the top and track the first minimum.
+	The sweep does 8 (AVX2) or 4 (SSE4.1) frames per step when the cpu has
+	them. A page's age starts at 0 when it is mapped, which is what the old
+	per-page counters held after eviction, so victims are unchanged.
+*/
+struct frame_t* select_victim_frame_aging(struct sim* sim) {
+
+	int minFid = aging_sweep(sim->ages, sim->refbits, sim->num_frames);
+
+	// the sweep consumed every R bit, clear them in the ptes as well
+	int words = (sim->num_frames + 63) / 64;
+	for(int w = 0; w < words; w++) {
+		clear_referenced(sim, w, ~0UL);
+	}
+
+	// free frames sit at age 0, so take the first oldest of the rest; a node-local choice takes it on the node
+	if(sim->freeCount || sim->victimHi - sim->victimLo < sim->num_frames) {
+		minFid = -1;
+		for(int i = sim->victimLo; i < sim->victimHi; i++) {
+			if(sim->frametable[i].pte && (minFid == -1 || sim->ages[i] < sim->ages[minFid])) {
+				minFid = i;
+			}
+		}
+	}
+
+	sim->ages[minFid] = 0;
+	return &sim->frametable[minFid];
+}
+
+// ages[i] = (ages[i] >> 1) | R << 31 for frames from..n-1, returns the first frame of minimum age
+int aging_sweep_scalar(unsigned int* ages, const unsigned long* refbits, int from, int n, int minFid) {
+
+	for(int i = from; i < n; i++) {
+		unsigned int r = (refbits[i / 64] >> (i % 64)) & 1;
+		ages[i] = (r << 31) | (ages[i] >> 1);
+		if(ages[i] < ages[minFid]) {
+			minFid = i;
+		}
+	}
+	return minFid;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// the 8 R bits of frames i..i+7 (i a multiple of 8)
+static inline unsigned int refbyte(const unsigned long* refbits, int i) {
+
+	return (refbits[i / 64] >> (i % 64)) & 0xff;
+}
+
+__attribute__((target("avx2")))
+static int aging_sweep_avx2(unsigned int* ages, const unsigned long* refbits, int n) {
+
+	const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m256i top = _mm256_set1_epi32((int) 0x80000000);
+	__m256i vmin = _mm256_set1_epi32(-1);
+	int vn = n & ~7;
+
+	for(int i = 0; i < vn; i += 8) {
+		__m256i r = _mm256_and_si256(_mm256_set1_epi32(refbyte(refbits, i)), lanes);
+		r = _mm256_and_si256(_mm256_cmpeq_epi32(r, lanes), top);
+		__m256i a = _mm256_loadu_si256((__m256i*) &ages[i]);
+		a = _mm256_or_si256(r, _mm256_srli_epi32(a, 1));
+		_mm256_storeu_si256((__m256i*) &ages[i], a);
+		vmin = _mm256_min_epu32(vmin, a);
+	}
+
+	unsigned int m[8];
+	_mm256_storeu_si256((__m256i*) m, vmin);
+	unsigned int minAge = UINT_MAX;
+	for(int j = 0; j < 8; j++) {
+		minAge = (m[j] < minAge) ? m[j] : minAge;
+	}
+
+	// tail frames, then locate the first frame holding the vector minimum
+	int minFid = aging_sweep_scalar(ages, refbits, vn, n, vn < n ? vn : 0);
+	if(vn == 0 || ages[minFid] < minAge || (ages[minFid] == minAge && minFid < vn)) {
+		return minFid;
+	}
+	const __m256i key = _mm256_set1_epi32((int) minAge);
+	for(int i = 0; ; i += 8) {
+		__m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*) &ages[i]), key);
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+}
+
+__attribute__((target("sse4.1")))
+static int aging_sweep_sse41(unsigned int* ages, const unsigned long* refbits, int n) {
+
+	const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+	const __m128i top = _mm_set1_epi32((int) 0x80000000);
+	__m128i vmin = _mm_set1_epi32(-1);
+	int vn = n & ~7;
+
+	for(int i = 0; i < vn; i += 8) {
+		unsigned int byte = refbyte(refbits, i);
+		for(int h = 0; h < 2; h++) {
+			__m128i r = _mm_and_si128(_mm_set1_epi32(byte >> (4 * h)), lanes);
+			r = _mm_and_si128(_mm_cmpeq_epi32(r, lanes), top);
+			__m128i a = _mm_loadu_si128((__m128i*) &ages[i + 4 * h]);
+			a = _mm_or_si128(r, _mm_srli_epi32(a, 1));
+			_mm_storeu_si128((__m128i*) &ages[i + 4 * h], a);
+			vmin = _mm_min_epu32(vmin, a);
+		}
+	}
+
+	unsigned int m[4];
+	_mm_storeu_si128((__m128i*) m, vmin);
+	unsigned int minAge = UINT_MAX;
+	for(int j = 0; j < 4; j++) {
+		minAge = (m[j] < minAge) ? m[j] : minAge;
+	}
+
+	int minFid = aging_sweep_scalar(ages, refbits, vn, n, vn < n ? vn : 0);
+	if(vn == 0 || ages[minFid] < minAge || (ages[minFid] == minAge && minFid < vn)) {
+		return minFid;
+	}
+	const __m128i key = _mm_set1_epi32((int) minAge);
+	for(int i = 0; ; i += 4) {
+		__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &ages[i]), key);
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+		if(mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+}
+
+#endif
+
+int aging_sweep(unsigned int* ages, const unsigned long* refbits, int n) {
+
+#if defined(__x86_64__) || defined(__i386__)
+	if(__builtin_cpu_supports("avx2")) {
+		return aging_sweep_avx2(ages, refbits, n);
+	}
+	if(__builtin_cpu_supports("sse4.1")) {
+		return aging_sweep_sse41(ages, refbits, n);
+	}
+#endif
+	return aging_sweep_scalar(ages, refbits, 0, n, 0);
+}
+
+
+// LRU keeps frames on a recency list ordered by last reference; the victim is the tail
+struct frame_t* select_victim_frame_lru(struct sim* sim) {
+
+	// a node-local choice walks up from the tail to the node's least recently used frame
+	int fid = sim->lruTail;
+	while(fid < sim->victimLo || fid >= sim->victimHi) {
+		fid = sim->frametable[fid].lru_prev;
+	}
+	return &sim->frametable[fid];
+}
+
+
+/*
+	Working set (w) and WSClock (W). Each process keeps its own virtual time,
+	the number of references it has made, so pages of processes that are not
+	running do not age. A frame remembers its owner's virtual time when its R
+	bit was last found set; a page whose age (owner's time now minus that) is
+	over tau has left its process's working set and may be evicted.
+
+	The working set pager folds every R bit into the last-use times on each
+	fault and takes the first page past tau, scanning from where it stopped
+	last time. If every page is in some working set, it takes the oldest.
+*/
+struct frame_t* select_victim_frame_ws(struct sim* sim) {
+
+	int words = (sim->num_frames + 63) / 64;
+	for(int w = 0; w < words; w++) {
+		for(unsigned long bits = sim->refbits[w]; bits; bits &= bits - 1) {
+			int fid = w * 64 + __builtin_ctzl(bits);
+			sim->lastUse[fid] = sim->procArray[sim->frametable[fid].pid].vtime;
+		}
+		clear_referenced(sim, w, ~0UL);
+	}
+
+	int lo = sim->victimLo, size = sim->victimHi - sim->victimLo;
+	int victim = -1, oldest = -1;
+	unsigned long oldestAge = 0;
+	for(int n = 0; n < size && victim == -1; n++) {
+		int fid = lo + (sim->frameInd - lo + n) % size;
+		if(!sim->frametable[fid].pte) {
+			continue;
+		}
+		unsigned long age = page_age(sim, fid);
+		if(age > WS_TAU) {
+			victim = fid;
+		} else if(oldest == -1 || age > oldestAge) {
+			oldest = fid;
+			oldestAge = age;
+		}
+	}
+
+	if(victim == -1) {
+		victim = oldest;
+	}
+	sim->frameInd = lo + (victim - lo + 1) % size;
+	return &sim->frametable[victim];
+}
+
+/*
+	WSClock walks a clock hand instead: a referenced page gets its last-use
+	time refreshed and its R bit cleared, and the first clean page past tau
+	is the victim. Dirty pages past tau are passed over for one revolution;
+	if no clean one turns up the first of them goes, and failing that the
+	oldest page seen.
+*/
+struct frame_t* select_victim_frame_wsclock(struct sim* sim) {
+
+	int lo = sim->victimLo, size = sim->victimHi - sim->victimLo;
+	int dirty = -1, oldest = -1;
+	unsigned long oldestAge = 0;
+
+	for(int n = 0; n < size; n++) {
+		int fid = sim->clockHand;
+		struct pte_t* pte = sim->frametable[fid].pte;
+		sim->clockHand = lo + (fid - lo + 1) % size;
+
+		if(!pte) {
+			continue;
+		}
+		if(pte->referenced) {
+			sim->lastUse[fid] = sim->procArray[sim->frametable[fid].pid].vtime;
+			pte->referenced = 0;
+			clear_bit(sim->refbits, fid);
+			continue;
+		}
+
+		unsigned long age = page_age(sim, fid);
+		if(age > WS_TAU) {
+			if(!pte->modified) {
+				return &sim->frametable[fid];
+			}
+			if(dirty == -1) {
+				dirty = fid;
+			}
+		}
+		if(oldest == -1 || age > oldestAge) {
+			oldest = fid;
+			oldestAge = age;
+		}
+	}
+
+	// a whole revolution of referenced pages leaves the hand where it started
+	int victim = (dirty != -1) ? dirty : (oldest != -1 ? oldest : sim->clockHand);
+	while(!sim->frametable[victim].pte) {
+		victim = lo + (victim - lo + 1) % size;
+	}
+	sim->clockHand = lo + (victim - lo + 1) % size;
+	return &sim->frametable[victim];
+}
+
+// virtual time since the page in fid was last seen referenced, in its own process's clock
+unsigned long page_age(struct sim* sim, int fid) {
+
+	return sim->procArray[sim->frametable[fid].pid].vtime - sim->lastUse[fid];
+}
+
+
+/*
+	ARC (A), CAR (C) and CLOCK-Pro (P) resist scans by telling pages used once
+	from pages used again, and adapt how much memory each kind gets from
+	ghost hits: faults on recently evicted pages, whose (pid, vpage) entries
+	are kept without a frame. Resident pages and ghosts share one history
+	pool, so a fault costs O(1) apart from the CAR and CLOCK-Pro hands, which
+	are amortized O(1) like the clock pager's.
+
+	The reference that completes a fault admits the page rather than hitting
+	it, so CAR and CLOCK-Pro clear the R bit it sets. Pages mapped without a
+	reference (the rest of a huge range) count their first reference the
+	same way.
+*/
+
+// the fault is on a ghost if the page's entry is still in the history
+int ghost_hit(struct sim* sim, unsigned long key) {
+
+	sim->faultEntry = hist_find(sim->hist, key);
+	if(sim->faultEntry != -1) {
+		sim->ghostHits++;
+	}
+	return sim->faultEntry;
+}
+
+/*
+	ARC keeps resident pages on LRU lists T1 (used once since they came in)
+	and T2 (used again), and the ghosts each evicted on B1 and B2. target is
+	the size T1 aims for: a ghost hit in B1 means T1 was too small, one in B2
+	that T2 was. T1 and B1 together hold at most num_frames pages, and all
+	four lists twice that.
+*/
+void arc_fault(struct sim* sim, unsigned long key) {
+
+	struct history* h = sim->hist;
+	int c = sim->num_frames;
+	int e = ghost_hit(sim, key);
+	sim->arcDiscard = false;
+
+	if(e != -1 && h->lists[e] == HIST_B1) {
+		int delta = h->size[HIST_B2] / h->size[HIST_B1];
+		sim->target += (delta > 1) ? delta : 1;
+		sim->target = (sim->target < c) ? sim->target : c;
+	} else if(e != -1) {
+		int delta = h->size[HIST_B1] / h->size[HIST_B2];
+		sim->target -= (delta > 1) ? delta : 1;
+		sim->target = (sim->target > 0) ? sim->target : 0;
+	} else if(h->size[HIST_T1] + h->size[HIST_B1] == c) {
+		if(h->size[HIST_T1] < c) {
+			hist_drop(h, h->head[HIST_B1]);
+		} else {
+			sim->arcDiscard = true;
+		}
+	} else if(h->size[HIST_T1] + h->size[HIST_T2] + h->size[HIST_B1] + h->size[HIST_B2] == 2 * c) {
+		hist_drop(h, h->head[HIST_B2]);
+	}
+}
+
+struct frame_t* select_victim_frame_arc(struct sim* sim) {
+
+	struct history* h = sim->hist;
+	int t1 = h->size[HIST_T1];
+	bool inB2 = sim->faultEntry != -1 && h->lists[sim->faultEntry] == HIST_B2;
+
+	if(sim->arcDiscard && !sim->reclaiming) {
+		int fid = h->frames[h->head[HIST_T1]];
+		hist_drop(h, h->head[HIST_T1]);
+		return &sim->frametable[fid];
+	}
+	if(t1 > 0 && (t1 > sim->target || (inB2 && t1 == sim->target) || h->size[HIST_T2] == 0)) {
+		return evict_to_ghost(sim, HIST_T1, HIST_B1);
+	}
+	return evict_to_ghost(sim, HIST_T2, HIST_B2);
+}
+
+// new pages go to the tail of T1 and ghost hits to the tail of T2
+void arc_admit(struct sim* sim, int fid) {
+
+	struct history* h = sim->hist;
+	struct frame_t* frame = &sim->frametable[fid];
+	int e = sim->faultEntry;
+
+	if(e == -1) {
+		e = hist_add(h, frame_key(sim, frame), fid);
+		hist_insert(h, HIST_T1, e, -1);
+	} else {
+		// CAR adapts once the victim is out, ARC did before choosing it
+		if(sim->pager == 'C' && h->lists[e] == HIST_B1) {
+			int delta = h->size[HIST_B2] / h->size[HIST_B1];
+			sim->target += (delta > 1) ? delta : 1;
+			sim->target = (sim->target < sim->num_frames) ? sim->target : sim->num_frames;
+		} else if(sim->pager == 'C') {
+			int delta = h->size[HIST_B1] / h->size[HIST_B2];
+			sim->target -= (delta > 1) ? delta : 1;
+			sim->target = (sim->target > 0) ? sim->target : 0;
+		}
+		hist_unlink(h, e);
+		h->frames[e] = fid;
+		hist_insert(h, HIST_T2, e, -1);
+	}
+
+	h->flags[e] = HIST_FRESH;
+	sim->frameEntry[fid] = e;
+	sim->faultEntry = -1;
+}
+
+// turn the head of resident list from into a ghost at the tail of to
+struct frame_t* evict_to_ghost(struct sim* sim, int from, int to) {
+
+	struct history* h = sim->hist;
+	int e = h->head[from];
+	int fid = h->frames[e];
+
+	hist_unlink(h, e);
+	h->frames[e] = -1;
+	hist_insert(h, to, e, -1);
+	return &sim->frametable[fid];
+}
+
+/*
+	CAR runs T1 and T2 as clocks over the R bit instead of LRU lists, so a
+	hit only sets R. The hand takes T1 while it holds at least target pages:
+	a referenced page there has been used again and moves to T2, a referenced
+	page in T2 goes round again.
+*/
+struct frame_t* select_victim_frame_car(struct sim* sim) {
+
+	struct history* h = sim->hist;
+	struct frame_t* victim = NULL;
+
+	while(victim == NULL) {
+		int t1 = h->size[HIST_T1];
+		int from = (t1 > 0 && (t1 >= sim->target || h->size[HIST_T2] == 0)) ? HIST_T1 : HIST_T2;
+		int e = h->head[from];
+		int fid = h->frames[e];
+		struct pte_t* pte = sim->frametable[fid].pte;
+
+		if(!pte->referenced) {
+			victim = evict_to_ghost(sim, from, from == HIST_T1 ? HIST_B1 : HIST_B2);
+		} else {
+			pte->referenced = 0;
+			clear_bit(sim->refbits, fid);
+			hist_unlink(h, e);
+			hist_insert(h, HIST_T2, e, -1);
+		}
+	}
+
+	// a new page makes room in the history as ARC's does, now that the victim's ghost is in it
+	if(sim->faultEntry == -1 && !sim->reclaiming) {
+		car_make_room(sim);
+	}
+	return victim;
+}
+
+void car_make_room(struct sim* sim) {
+
+	struct history* h = sim->hist;
+	int c = sim->num_frames;
+	if(h->size[HIST_T1] + h->size[HIST_B1] == c) {
+		hist_drop(h, h->head[HIST_B1]);
+	} else if(h->size[HIST_T1] + h->size[HIST_T2] + h->size[HIST_B1] + h->size[HIST_B2] == 2 * c) {
+		hist_drop(h, h->head[HIST_B2]);
+	}
+}
+
+// a hit moves an ARC page to the tail of T2; CAR and CLOCK-Pro go by the R bit
+void adapt_referenced(struct sim* sim, int fid) {
+
+	struct history* h = sim->hist;
+	int e = sim->frameEntry[fid];
+
+	if(h->flags[e] & HIST_FRESH) {
+		h->flags[e] &= ~HIST_FRESH;
+		if(sim->pager != 'A') {
+			sim->frametable[fid].pte->referenced = 0;
+			clear_bit(sim->refbits, fid);
+		}
+	} else if(sim->pager == 'A') {
+		hist_unlink(h, e);
+		hist_insert(h, HIST_T2, e, -1);
+	}
+}
+
+/*
+	CLOCK-Pro keeps resident hot and cold pages on one clock together with
+	the ghosts of cold pages still in their test period. A new page comes in
+	cold and in test; a cold page referenced again within its test period
+	turns hot, and a ghost faulted on within it comes back hot and gives cold
+	pages one more frame of target. A test period that runs out takes one away.
+
+	Three hands go round: the cold hand reclaims unreferenced cold pages,
+	keeping the ghost of those in test, the hot hand turns unreferenced hot
+	pages cold while there are more hot pages than num_frames - target, and
+	the test hand ends test periods while there are more ghosts than frames.
+	Pages are put back at the head of the clock, just behind the hot hand.
+*/
+struct frame_t* select_victim_frame_clockpro(struct sim* sim) {
+
+	struct history* h = sim->hist;
+	int victim = -1;
+
+	while(victim == -1) {
+		if(sim->countCold == 0) {
+			clockpro_hand_hot(sim);
+			continue;
+		}
+
+		int e = sim->handCold;
+		sim->handCold = hist_next(h, e);
+		if(h->frames[e] == -1 || (h->flags[e] & HIST_HOT)) {
+			continue;
+		}
+
+		int fid = h->frames[e];
+		struct pte_t* pte = sim->frametable[fid].pte;
+		if(pte->referenced) {
+			pte->referenced = 0;
+			clear_bit(sim->refbits, fid);
+			if(h->flags[e] & HIST_TEST) {
+				h->flags[e] = (h->flags[e] & ~HIST_TEST) | HIST_HOT;
+				sim->countCold--;
+				sim->countHot++;
+			} else {
+				h->flags[e] |= HIST_TEST;
+			}
+			clockpro_unlink(sim, e);
+			clockpro_push(sim, e);
+		} else {
+			victim = fid;
+			sim->countCold--;
+			if(h->flags[e] & HIST_TEST) {
+				h->frames[e] = -1;
+				sim->countTest++;
+			} else {
+				clockpro_unlink(sim, e);
+				hist_drop(h, e);
+			}
+		}
+	}
+
+	while(sim->countTest > sim->num_frames) {
+		clockpro_hand_test(sim);
+	}
+	while(sim->countHot > sim->num_frames - sim->target) {
+		clockpro_hand_hot(sim);
+	}
+	return &sim->frametable[victim];
+}
+
+void clockpro_admit(struct sim* sim, int fid) {
+
+	struct history* h = sim->hist;
+	struct frame_t* frame = &sim->frametable[fid];
+	int e = sim->faultEntry;
+
+	if(e == -1) {
+		e = hist_add(h, frame_key(sim, frame), fid);
+		h->flags[e] = HIST_FRESH | HIST_TEST;
+		sim->countCold++;
+	} else {
+		if(sim->target < sim->num_frames) {
+			sim->target++;
+		}
+		h->frames[e] = fid;
+		h->flags[e] = HIST_FRESH | HIST_HOT;
+		sim->countHot++;
+	}
+
+	clockpro_push(sim, e);
+	sim->frameEntry[fid] = e;
+	sim->faultEntry = -1;
+}
+
+// move the hot hand on until it has turned one hot page cold, ending the test periods it passes
+void clockpro_hand_hot(struct sim* sim) {
+
+	struct history* h = sim->hist;
+
+	while(sim->countHot > 0) {
+		int e = sim->handHot;
+		sim->handHot = hist_next(h, e);
+
+		if(h->flags[e] & HIST_HOT) {
+			int fid = h->frames[e];
+			struct pte_t* pte = sim->frametable[fid].pte;
+			if(!pte->referenced) {
+				h->flags[e] &= ~HIST_HOT;
+				sim->countHot--;
+				sim->countCold++;
+				return;
+			}
+			pte->referenced = 0;
+			clear_bit(sim->refbits, fid);
+		} else if(h->flags[e] & HIST_TEST) {
+			clockpro_end_test(sim, e);
+		}
+	}
+}
+
+// move the test hand on until it has dropped a ghost
+void clockpro_hand_test(struct sim* sim) {
+
+	struct history* h = sim->hist;
+	int ghosts = sim->countTest;
+
+	while(sim->countTest == ghosts) {
+		int e = sim->handTest;
+		sim->handTest = hist_next(h, e);
+		if(h->flags[e] & HIST_TEST) {
+			clockpro_end_test(sim, e);
+		}
+	}
+}
+
+// e was not reused within its test period: it leaves the clock if it is a ghost, and cold pages get less room
+void clockpro_end_test(struct sim* sim, int e) {
+
+	struct history* h = sim->hist;
+	h->flags[e] &= ~HIST_TEST;
+	if(sim->target > 1) {
+		sim->target--;
+	}
+
+	if(h->frames[e] == -1) {
+		clockpro_unlink(sim, e);
+		hist_drop(h, e);
+		sim->countTest--;
+	}
+}
+
+// take e off the clock, moving any hand on it to the next entry
+void clockpro_unlink(struct sim* sim, int e) {
+
+	struct history* h = sim->hist;
+	int next = (h->size[HIST_RING] > 1) ? hist_next(h, e) : -1;
+
+	if(sim->handHot == e) sim->handHot = next;
+	if(sim->handCold == e) sim->handCold = next;
+	if(sim->handTest == e) sim->handTest = next;
+	hist_unlink(h, e);
+}
+
+// e goes to the head of the clock, the last place the hot hand reaches
+void clockpro_push(struct sim* sim, int e) {
+
+	hist_insert(sim->hist, HIST_RING, e, sim->handHot);
+	if(sim->handHot == -1) {
+		sim->handHot = sim->handCold = sim->handTest = e;
+	}
+}
+
+
+/*
+	Belady's OPT: evict the resident page whose next reference is furthest
+	away. Keys come from the next-use index built when the trace was loaded
+	and resident frames sit in a max-heap on that key, so a fault is O(1)
+	and each reference O(log F).
+*/
+struct frame_t* select_victim_frame_opt(struct sim* sim) {
+
+	return &sim->frametable[sim->optHeap[0]];
+}
+
+
+/*
+	Pagers that order frames by their references are told about every
+	reference, including the one that follows a fault, and about pages
+	mapped without being referenced (the rest of a huge range)
+*/
+void pager_mapped(struct sim* sim, int fid) {
+	switch(sim->pager) {
+		case 'l':
+			lru_touch(sim, fid);
+			break;
+	}
+}
+
+void pager_referenced(struct sim* sim, int fid) {
+	switch(sim->pager) {
+		case 'l':
+			lru_touch(sim, fid);
+			break;
+		case 'o':
+			opt_touch(sim, fid);
+			break;
+		case 'A':
+		case 'C':
+		case 'P':
+			adapt_referenced(sim, fid);
+			break;
+	}
+}
+
+// tell the history pagers about a fault before its frame is chosen, and the page once it has one
+// key is the faulting page's, see frame_key
+void pager_fault(struct sim* sim, unsigned long key) {
+	switch(sim->pager) {
+		case 'A':
+			arc_fault(sim, key);
+			break;
+		case 'C':
+			// no victim will make room if kswapd left a free frame
+			if(ghost_hit(sim, key) == -1 && sim->freeCount > 0) {
+				car_make_room(sim);
+			}
+			break;
+		case 'P':
+			if(ghost_hit(sim, key) != -1) {
+				clockpro_unlink(sim, sim->faultEntry);
+				sim->countTest--;
+			}
+			break;
+	}
+}
+
+void pager_admit(struct sim* sim, int fid) {
+	switch(sim->pager) {
+		case 'A':
+		case 'C':
+			arc_admit(sim, fid);
+			break;
+		case 'P':
+			clockpro_admit(sim, fid);
+			break;
+	}
+}
+
+/*
+	kswapd has taken the page in fid: pagers that keep frames on their own
+	lists drop it. The history pagers already moved it to a ghost or out
+	when they chose it, and the rest pass over free frames.
+*/
+void pager_release(struct sim* sim, int fid) {
+	switch(sim->pager) {
+		case 'l':
+			lru_unlink(sim, fid);
+			break;
+		case 'o':
+			opt_remove(sim, fid);
+			break;
+	}
+}
+
+// move fid to the head of the recency list
+void lru_touch(struct sim* sim, int fid) {
+
+	struct frame_t* frametable = sim->frametable;
+	struct frame_t* frame = &frametable[fid];
+
+	if(sim->lruHead == fid) {
+		return;
+	}
+
+	// unlink, if it is on the list already
+	if(frame->lru_prev != -1) {
+		frametable[frame->lru_prev].lru_next = frame->lru_next;
+		if(frame->lru_next != -1) {
+			frametable[frame->lru_next].lru_prev = frame->lru_prev;
+		} else {
+			sim->lruTail = frame->lru_prev;
+		}
+	}
+
+	frame->lru_prev = -1;
+	frame->lru_next = sim->lruHead;
+	if(sim->lruHead != -1) {
+		frametable[sim->lruHead].lru_prev = fid;
+	}
+	sim->lruHead = fid;
+	if(sim->lruTail == -1) {
+		sim->lruTail = fid;
+	}
+}
+
+void lru_unlink(struct sim* sim, int fid) {
+
+	struct frame_t* frametable = sim->frametable;
+	struct frame_t* frame = &frametable[fid];
+
+	if(frame->lru_prev != -1) {
+		frametable[frame->lru_prev].lru_next = frame->lru_next;
+	} else {
+		sim->lruHead = frame->lru_next;
+	}
+	if(frame->lru_next != -1) {
+		frametable[frame->lru_next].lru_prev = frame->lru_prev;
+	} else {
+		sim->lruTail = frame->lru_prev;
+	}
+	frame->lru_prev = frame->lru_next = -1;
+}
+
+// rekey fid with the next use of the current reference. instCount is the reference's position in the trace
+void opt_touch(struct sim* sim, int fid) {
+
+	int pos = sim->optHeapPos[fid];
+	if(pos == -1) {
+		pos = sim->optHeapSize++;
+		sim->optHeap[pos] = fid;
+		sim->optHeapPos[fid] = pos;
+	}
+
+	sim->optKey[fid] = sim->layout->nextUse[sim->instCount];
+	opt_sift_up(sim, pos);
+	opt_sift_down(sim, sim->optHeapPos[fid]);
+}
+
+// take fid out of the heap, the last entry fills its place
+void opt_remove(struct sim* sim, int fid) {
+
+	int pos = sim->optHeapPos[fid];
+	int last = --sim->optHeapSize;
+
+	if(pos != last) {
+		int moved = sim->optHeap[last];
+		opt_swap(sim, pos, last);
+		opt_sift_up(sim, pos);
+		opt_sift_down(sim, sim->optHeapPos[moved]);
+	}
+	sim->optHeapPos[fid] = -1;
+}
+
+void opt_sift_up(struct sim* sim, int pos) {
+
+	while(pos > 0) {
+		int parent = (pos - 1) / 2;
+		if(sim->optKey[sim->optHeap[parent]] >= sim->optKey[sim->optHeap[pos]]) {
+			return;
+		}
+		opt_swap(sim, pos, parent);
+		pos = parent;
+	}
+}
+
+void opt_sift_down(struct sim* sim, int pos) {
+
+	while(true) {
+		int largest = pos, l = 2 * pos + 1, r = 2 * pos + 2;
+		if(l < sim->optHeapSize && sim->optKey[sim->optHeap[l]] > sim->optKey[sim->optHeap[largest]]) {
+			largest = l;
+		}
+		if(r < sim->optHeapSize && sim->optKey[sim->optHeap[r]] > sim->optKey[sim->optHeap[largest]]) {
+			largest = r;
+		}
+		if(largest == pos) {
+			return;
+		}
+		opt_swap(sim, pos, largest);
+		pos = largest;
+	}
+}
+
+void opt_swap(struct sim* sim, int a, int b) {
+
+	int fa = sim->optHeap[a], fb = sim->optHeap[b];
+	sim->optHeap[a] = fb;
+	sim->optHeap[b] = fa;
+	sim->optHeapPos[fb] = a;
+	sim->optHeapPos[fa] = b;
+}
+
+
+struct frame_t* createFrameTable(int num_frames) {
+
+	struct frame_t* frametable = (struct frame_t*) malloc(sizeof(struct frame_t) * num_frames);
+
+	for(int i = 0; i < num_frames; i++) {
 		frametable[i].fid = i;
 		frametable[i].pid = UINT_MAX;
-		frametable[i].vpage = UINT_MAX;
+		frametable[i].vpage = ULONG_MAX;
+		frametable[i].pte = NULL;
+		frametable[i].lru_prev = -1;
+		frametable[i].lru_next = -1;
+		frametable[i].mapcount = 0;
+		frametable[i].rmap = -1;
+		frametable[i].objpage = -1;
+		frametable[i].node = 0;
+	}
+
+	return frametable;
+}
+
+// NUMA_NODES nodes splitting the frames as evenly as they divide
+struct numa_node* createNodes(struct frame_t* frametable, int num_frames) {
+
+	if(num_frames < NUMA_NODES) {
+		printf("Error: Fewer frames than memory nodes\n");
+		exit(1);
+	}
+
+	struct numa_node* numa = (struct numa_node*) malloc(sizeof(struct numa_node) * NUMA_NODES);
+	for(int n = 0; n < NUMA_NODES; n++) {
+		numa[n].lo = (int) ((long) n * num_frames / NUMA_NODES);
+		numa[n].hi = (int) ((long) (n + 1) * num_frames / NUMA_NODES);
+		numa[n].next = numa[n].lo;
+		numa[n].freeCount = 0;
+		numa[n].frameInd = numa[n].clockHand = numa[n].lo;
+		for(int i = numa[n].lo; i < numa[n].hi; i++) {
+			frametable[i].node = n;
+		}
+	}
+
+	return numa;
+}
+
+
+struct trace* openTrace(char* filename) {
+
+	struct trace* tr = (struct trace*) malloc(sizeof(struct trace));
+	tr->fp = NULL;
+	tr->buf = NULL;
+	tr->len = 0;
+	tr->binary = false;
+	tr->cur = tr->end = NULL;
+	tr->layout = NULL;
+	tr->gen = NULL;
+
+	if(strcmp(filename, "-") == 0) {
+		tr->fp = stdin;
+		detectBinary(tr);
+		return tr;
+	}
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) {
+		free(tr);
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(buf != MAP_FAILED) {
+			madvise(buf, st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+			tr->buf = (char*) buf;
+			tr->len = st.st_size;
+			tr->cur = tr->buf;
+			tr->end = tr->buf + tr->len;
+			detectBinary(tr);
+			return tr;
+		}
+	}
+
+	// pipes, fifos and anything mmap refuses are streamed
+	tr->fp = fdopen(fd, "r");
+	if(!tr->fp) {
+		close(fd);
+		free(tr);
+		return NULL;
+	}
+	detectBinary(tr);
+	return tr;
+}
+
+// consume TRACE_MAGIC if present. Text traces start with '#', so one byte of lookahead decides
+void detectBinary(struct trace* tr) {
+
+	if(tr->buf) {
+		if(tr->len >= TRACE_MAGIC_LEN && memcmp(tr->buf, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+			tr->binary = true;
+			tr->cur += TRACE_MAGIC_LEN;
+		}
+		return;
+	}
+
+	int c = getc(tr->fp);
+	if(c != (unsigned char) TRACE_MAGIC[0]) {
+		ungetc(c, tr->fp);
+		return;
+	}
+
+	char magic[TRACE_MAGIC_LEN];
+	if(fread(magic + 1, 1, TRACE_MAGIC_LEN - 1, tr->fp) != TRACE_MAGIC_LEN - 1 ||
+	   memcmp(magic + 1, TRACE_MAGIC + 1, TRACE_MAGIC_LEN - 1) != 0) {
+		printf("Error: Corrupt binary trace header\n");
+		exit(1);
+	}
+	tr->binary = true;
+}
+
+void closeTrace(struct trace* tr) {
+
+	if(tr->layout) {
+		freeLayout(tr->layout);
+	}
+	if(tr->gen) {
+		closeGenerator(tr->gen);
+	} else if(tr->buf) {
+		munmap(tr->buf, tr->len);
+	} else if(tr->fp != stdin) {
+		fclose(tr->fp);
+	}
+	free(tr);
+}
+
+// fgets() over either backing, used for the process/vma header
+bool trace_gets(struct trace* tr, char* line, int size) {
+
+	if(!tr->buf) {
+		return fgets(line, size, tr->fp) != NULL;
+	}
+
+	if(tr->cur == tr->end) {
+		return false;
+	}
+
+	int n = 0;
+	while(n < size - 1 && tr->cur < tr->end) {
+		char c = *tr->cur++;
+		line[n++] = c;
+		if(c == '\n') {
+			break;
+		}
+	}
+	line[n] = '\0';
+	return true;
+}
+
+int trace_byte(struct trace* tr) {
+
+	if(tr->buf) {
+		return tr->cur < tr->end ? (unsigned char) *tr->cur++ : EOF;
+	}
+	return getc(tr->fp);
+}
+
+unsigned long trace_varint(struct trace* tr) {
+
+	unsigned long v = 0;
+	int shift = 0;
+	int c;
+
+	do {
+		if((c = trace_byte(tr)) == EOF) {
+			printf("Error: Truncated binary trace\n");
+			exit(1);
+		}
+		v |= (unsigned long) (c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+
+	return v;
+}
+
+// byte offset of the next instruction, -1 if the trace cannot seek
+long trace_tell(struct trace* tr) {
+
+	if(tr->gen) {
+		return -1;
+	}
+	return tr->buf ? tr->cur - tr->buf : ftell(tr->fp);
+}
+
+void trace_seek(struct trace* tr, long pos) {
+
+	if(tr->buf) {
+		if(pos < 0 || (size_t) pos > tr->len) {
+			printf("Error: Checkpoint is past the end of the trace\n");
+			exit(1);
+		}
+		tr->cur = tr->buf + pos;
+	} else if(fseek(tr->fp, pos, SEEK_SET) != 0) {
+		printf("Error: Could not seek the trace\n");
+		exit(1);
+	}
+}
+
+// decode up to max instructions into insts, returns how many were read
+size_t read_instructions(struct trace* tr, struct inst* insts, size_t max) {
+
+	if(tr->gen) {
+		return gen_read(tr->gen, insts, max);
+	}
+
+	size_t n = 0;
+	while(n < max && get_next_instruction(tr, &insts[n])) {
+		n++;
+	}
+	return n;
+}
+
+// decode the whole remaining trace into one buffer, plus the next-use index if an offline pager will replay it
+struct inst* loadTrace(struct trace* tr, size_t* count) {
+
+	size_t cap = INST_CHUNK, n = 0, got;
+	struct inst* insts = (struct inst*) malloc(sizeof(struct inst) * cap);
+
+	while((got = read_instructions(tr, insts + n, cap - n)) > 0) {
+		n += got;
+		if(n == cap) {
+			cap *= 2;
+			insts = (struct inst*) realloc(insts, sizeof(struct inst) * cap);
+			if(!insts) {
+				printf("Error: Out of memory decoding trace\n");
+				exit(1);
+			}
+		}
+	}
+
+	*count = n;
+	if(strpbrk(PAGERS, OFFLINE_PAGERS)) {
+		tr->layout->nextUse = createNextUse(tr->layout, insts, n);
+	}
+	return insts;
+}
+
+/*
+	nextUse[i] is the position of the next reference to the page referenced
+	at i (NEVER if there is none). One forward pass: remembering where each
+	page was last referenced lets every reference fill in its predecessor's
+	entry, which needs no per-position pid bookkeeping that a backward pass
+	over context switches would.
+*/
+size_t* createNextUse(const struct layout* layout, const struct inst* insts, size_t count) {
+
+	size_t* next = (size_t*) malloc(sizeof(size_t) * (count ? count : 1));
+	struct pagemap* pages = createPageMap();
+	size_t* last = NULL; // indexed by pagemap_index
+	size_t npages = 0, cap = 0;
+	unsigned int pid = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		next[i] = NEVER;
+		if(insts[i].op == 'c') {
+			pid = insts[i].vpage;
+			continue;
+		}
+		if(insts[i].vpage >= layout->numVpages) {
+			continue;
+		}
+
+		size_t k = pagemap_index(pages, pid, insts[i].vpage);
+		if(k == npages) {
+			if(npages == cap) {
+				cap = cap ? 2 * cap : 1024;
+				last = (size_t*) realloc(last, sizeof(size_t) * cap);
+				if(!last) {
+					printf("Error: Out of memory tracking pages\n");
+					exit(1);
+				}
+			}
+			npages++;
+			last[k] = NEVER;
+		}
+		if(last[k] != NEVER) {
+			next[last[k]] = i;
+		}
+		last[k] = i;
+	}
+
+	free(last);
+	freePageMap(pages);
+	return next;
+}
+
+bool get_next_instruction(struct trace* tr, struct inst* in) {
+
+	if(tr->binary) {
+		return get_next_binary_instruction(tr, in);
+	}
+
+	if(!tr->buf) {
+		char line[100];
+		char* p;
+		do {
+			if(!fgets(line, 100, tr->fp)) {
+				return false;
+			}
+			p = line + strspn(line, " \t\r\n");
+		} while(*p == '\0');
+
+		return scan_instruction(p, p + strlen(p), in) != NULL;
+	}
+
+	tr->cur = scan_instruction(tr->cur, tr->end, in);
+	if(!tr->cur) {
+		tr->cur = tr->end;
+		return false;
+	}
+	return true;
+}
+
+// one byte per op, see mmutrace.h
+bool get_next_binary_instruction(struct trace* tr, struct inst* in) {
+
+	int c;
+	if(tr->buf) {
+		if(tr->cur == tr->end) {
+			return false;
+		}
+		c = (unsigned char) *tr->cur++;
+	} else if((c = getc(tr->fp)) == EOF) {
+		return false;
+	}
+
+	int opcode = c >> OP_SHIFT;
+	if(opcode != OP_ESCAPE) {
+		in->op = TRACE_OPS[opcode];
+		in->vpage = c & OPERAND_MASK;
+		return true;
+	}
+
+	opcode = c & OPERAND_MASK;
+	if(opcode == ESC_END) {
+		tr->cur = tr->end;
+		return false;
+	}
+	if(opcode >= OP_ESCAPE) {
+		printf("Error: Corrupt binary trace\n");
+		exit(1);
+	}
+
+	in->op = TRACE_OPS[opcode];
+	in->vpage = trace_varint(tr);
+	return true;
+}
+
+/*
+	Hand-rolled scanner for one "<op> <vpage>" line starting at p. Fills in and
+	returns the start of the next line, or NULL at the end of the instruction
+	section ('#' line or end of input).
+*/
+const char* scan_instruction(const char* p, const char* end, struct inst* in) {
+
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+
+	if(p == end || *p == '#') {
+		return NULL;
+	}
+
+	in->op = *p++;
+	while(p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+
+	unsigned long vpage = 0;
+	while(p < end && (unsigned char) (*p - '0') < 10) {
+		vpage = vpage * 10 + (*p++ - '0');
+	}
+	in->vpage = vpage;
+
+	while(p < end && *p++ != '\n');
+	return p;
+}
+
+
+// read the process/vma header into tr->layout
+void createProcArray(struct trace* tr) {
+
+	struct layout* layout = (struct layout*) malloc(sizeof(struct layout));
+	layout->nextUse = NULL;
+	tr->layout = layout;
+
+	if(tr->binary) {
+		createProcArrayBinary(tr, layout);
+		return;
+	}
+
+	char line[100];
+	char* save; // batches read several headers at once, so no strtok
+	trace_gets(tr, line, 100); trace_gets(tr, line, 100); trace_gets(tr, line, 100); trace_gets(tr, line, 100);
+	layout->procCount = atoi(strtok_r(line, delims, &save));
+	layout->procs = (struct process*) malloc(sizeof(struct process) * layout->procCount);
+	int vmaCount = 0;
+
+	for(int i = 0; i < layout->procCount; i++) {
+
+		trace_gets(tr, line, 100); trace_gets(tr, line, 100); trace_gets(tr, line, 100);
+		vmaCount = atoi(strtok_r(line, delims, &save));
+		layout->procs[i].pid = i;
+		layout->procs[i].vma_list = createList();
+
+		// add vma's to process vma_list
+		for(int j = 0; j < vmaCount; j++) {
+
+			trace_gets(tr, line, 100);
+			unsigned long start = strtoul(strtok_r(line, delims, &save), NULL, 10);
+			unsigned long end = strtoul(strtok_r(NULL, delims, &save), NULL, 10);
+			unsigned int write_protect = atoi(strtok_r(NULL, delims, &save));
+			unsigned int filemapped = atoi(strtok_r(NULL, delims, &save));
+			char* huge = strtok_r(NULL, delims, &save); // optional huge page size class, 1 = 2MB, 2 = 1GB
+			char* share = strtok_r(NULL, delims, &save); // optional shared object, see parseShare
+			struct vma_t* vma = createVma(start, end, write_protect, filemapped, huge ? atoi(huge) : 0);
+			if(share) {
+				parseShare(vma, share);
+			}
+			add(layout->procs[i].vma_list, (void*) vma);
+		}
+	}
+
+	trace_gets(tr, line, 100);
+	createVmaLookups(layout);
+}
+
+void createProcArrayBinary(struct trace* tr, struct layout* layout) {
+
+	layout->procCount = trace_varint(tr);
+	layout->procs = (struct process*) malloc(sizeof(struct process) * layout->procCount);
+
+	for(int i = 0; i < layout->procCount; i++) {
+
+		unsigned long vmaCount = trace_varint(tr);
+		layout->procs[i].pid = i;
+		layout->procs[i].vma_list = createList();
+
+		for(unsigned long j = 0; j < vmaCount; j++) {
+			unsigned long start = trace_varint(tr);
+			unsigned long end = trace_varint(tr);
+			unsigned long flags = trace_varint(tr);
+			struct vma_t* vma = createVma(start, end, (flags & VMA_WRITE_PROTECT) != 0,
+				(flags & VMA_FILEMAPPED) != 0, (flags & VMA_HUGE_MASK) >> VMA_HUGE_SHIFT);
+			if(flags & (VMA_SHARED | VMA_COW)) {
+				vma->shared = (flags & VMA_SHARED) != 0;
+				vma->cow = !vma->shared;
+				vma->obj = trace_varint(tr);
+			}
+			add(layout->procs[i].vma_list, (void*) vma);
+		}
+	}
+
+	createVmaLookups(layout);
+}
+
+/*
+	The address space is the smallest power of two, at least 64 pages, that
+	covers every vma, up to 48-bit vpages. Page tables get as many 9-bit
+	radix levels as that takes; small spaces keep the flat vmatable and large
+	ones search an interval tree over the vma list. Either way a vpage in
+	several overlapping vmas resolves to the first of them in the header.
+*/
+void createVmaLookups(struct layout* layout) {
+
+	struct process* procs = layout->procs;
+	unsigned long maxEnd = 0;
+	for(int i = 0; i < layout->procCount; i++) {
+		for(struct node* h = procs[i].vma_list->head; h != NULL; h = h->next) {
+			struct vma_t* vma = (struct vma_t*) h->val;
+			maxEnd = (vma->end_vpage > maxEnd) ? vma->end_vpage : maxEnd;
+		}
+	}
+
+	int bits = MIN_VPAGE_BITS;
+	while(bits < 64 && (maxEnd >> bits) != 0) {
+		bits++;
+	}
+	if(bits > MAX_VPAGE_BITS) {
+		printf("Error: vpage %lu is beyond a %d-bit address space\n", maxEnd, MAX_VPAGE_BITS);
+		exit(1);
+	}
+	if(layout->procCount > MAX_PROCS) {
+		printf("Error: %d processes, at most %d are supported\n", layout->procCount, MAX_PROCS);
+		exit(1);
+	}
+	layout->numVpages = 1UL << bits;
+	layout->ptLevels = (bits + PT_BITS - 1) / PT_BITS;
+	layout->hugeEnabled = false;
+	layout->sharing = false;
+
+	for(int i = 0; i < layout->procCount; i++) {
+		procs[i].pagetable = NULL;
+		procs[i].ptLeaf = NULL;
+		procs[i].layout = layout;
+		procs[i].hugeClasses = 0;
+		unsigned int id = 0;
+		for(struct node* h = procs[i].vma_list->head; h != NULL; h = h->next) {
+			struct vma_t* vma = (struct vma_t*) h->val;
+			vma->id = id++;
+			procs[i].hugeClasses |= vma->huge ? 1U << vma->huge : 0;
+			if(vma->shared || vma->cow) {
+				if(vma->huge || vma->obj == 0 || vma->obj > MAX_OBJECT) {
+					printf("Error: Bad shared vma %lu-%lu\n", vma->start_vpage, vma->end_vpage);
+					exit(1);
+				}
+				layout->sharing = true;
+			}
+		}
+		layout->hugeEnabled = layout->hugeEnabled || procs[i].hugeClasses;
+		procs[i].vmatable = NULL;
+		procs[i].vmasorted = NULL;
+		procs[i].vmaMaxEnd = NULL;
+		procs[i].vmaMinId = NULL;
+
+		if(layout->numVpages <= VMATABLE_MAX) {
+			procs[i].vmatable = createVmaTable(procs[i].vma_list, layout->numVpages);
+			continue;
+		}
+
+		struct list* l = procs[i].vma_list;
+		size_t size = l->size ? l->size : 1;
+		procs[i].vmasorted = (struct vma_t**) malloc(sizeof(struct vma_t*) * size);
+		procs[i].vmaMaxEnd = (unsigned long*) malloc(sizeof(unsigned long) * size);
+		procs[i].vmaMinId = (unsigned int*) malloc(sizeof(unsigned int) * size);
+		int n = 0;
+		for(struct node* h = l->head; h != NULL; h = h->next) {
+			procs[i].vmasorted[n++] = (struct vma_t*) h->val;
+		}
+		qsort(procs[i].vmasorted, n, sizeof(struct vma_t*), compareVmas);
+		vma_tree_build(&procs[i], 0, n - 1);
+	}
+}
+
+/*
+	The vmas sorted by start form an implicit balanced tree: the root of
+	lo..hi is their midpoint. Each position records the largest end and the
+	smallest id (header order) in its subtree, so a search skips subtrees
+	that end before the vpage or hold no vma earlier than one already found.
+*/
+void vma_tree_build(struct process* proc, int lo, int hi) {
+
+	if(lo > hi) {
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	vma_tree_build(proc, lo, mid - 1);
+	vma_tree_build(proc, mid + 1, hi);
+
+	unsigned long maxEnd = proc->vmasorted[mid]->end_vpage;
+	unsigned int minId = proc->vmasorted[mid]->id;
+	for(int child = 0; child < 2; child++) {
+		int clo = child ? mid + 1 : lo, chi = child ? hi : mid - 1;
+		if(clo <= chi) {
+			int c = clo + (chi - clo) / 2;
+			maxEnd = (proc->vmaMaxEnd[c] > maxEnd) ? proc->vmaMaxEnd[c] : maxEnd;
+			minId = (proc->vmaMinId[c] < minId) ? proc->vmaMinId[c] : minId;
+		}
+	}
+	proc->vmaMaxEnd[mid] = maxEnd;
+	proc->vmaMinId[mid] = minId;
+}
+
+// first vma in header order containing vpage, into best
+void vma_tree_find(struct process* proc, int lo, int hi, unsigned long vpage, struct vma_t** best) {
+
+	if(lo > hi) {
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	if(proc->vmaMaxEnd[mid] < vpage || (*best && proc->vmaMinId[mid] >= (*best)->id)) {
+		return;
+	}
+
+	vma_tree_find(proc, lo, mid - 1, vpage, best);
+
+	// everything right of mid starts later still
+	struct vma_t* vma = proc->vmasorted[mid];
+	if(vma->start_vpage <= vpage) {
+		if(vpage <= vma->end_vpage && (!*best || vma->id < (*best)->id)) {
+			*best = vma;
+		}
+		vma_tree_find(proc, mid + 1, hi, vpage, best);
+	}
+}
+
+int compareVmas(const void* a, const void* b) {
+
+	const struct vma_t* va = *(struct vma_t* const*) a;
+	const struct vma_t* vb = *(struct vma_t* const*) b;
+	return (va->start_vpage > vb->start_vpage) - (va->start_vpage < vb->start_vpage);
+}
+
+// per-run copy of the layout's processes with fresh page tables and stats; vmas are shared
+struct process* createSimProcArray(const struct layout* layout) {
+
+	struct process* procArray = (struct process*) malloc(sizeof(struct process) * layout->procCount);
+
+	for(int i = 0; i < layout->procCount; i++) {
+		procArray[i] = layout->procs[i];
+		procArray[i].pagetable = NULL;
+		procArray[i].ptLeaf = NULL;
+		procArray[i].vtime = 0;
+		procArray[i].home = procArray[i].pid % NUMA_NODES;
+		procArray[i].pstat = createPstat();
+		procArray[i].ra = READAHEAD_MAX ? (struct readahead*) calloc(procArray[i].vma_list->size + 1, sizeof(struct readahead)) : NULL;
+	}
+
+	return procArray;
+}
+
+void freeLayout(struct layout* layout) {
+
+	for(int i = 0; i < layout->procCount; i++) {
+		struct node* h = layout->procs[i].vma_list->head;
+		while(h != NULL) {
+			struct node* next = h->next;
+			free(h->val);
+			free(h);
+			h = next;
+		}
+		free(layout->procs[i].vma_list);
+		free(layout->procs[i].vmatable);
+		free(layout->procs[i].vmasorted);
+		free(layout->procs[i].vmaMaxEnd);
+		free(layout->procs[i].vmaMinId);
+	}
+	free(layout->procs);
+	free(layout->nextUse);
+	free(layout);
+}
+
+struct vma_t* createVma(unsigned long start, unsigned long end, unsigned int write_protect, unsigned int filemapped, unsigned int huge) {
+
+	if(huge > 2) {
+		printf("Error: Bad huge page class %u\n", huge);
+		exit(1);
+	}
+
+	struct vma_t* vma = (struct vma_t*) malloc(sizeof(struct vma_t));
+	vma->start_vpage = start;
+	vma->end_vpage = end;
+	vma->write_protect = write_protect;
+	vma->filemapped = filemapped;
+	vma->huge = huge;
+	vma->shared = 0;
+	vma->cow = 0;
+	vma->obj = 0;
+	return vma;
+}
+
+// sixth vma column: 0 for a private vma, s<id> maps shared object id and c<id> maps it copy-on-write
+void parseShare(struct vma_t* vma, const char* spec) {
+
+	if(strcmp(spec, "0") == 0) {
+		return;
+	}
+	if(spec[0] != 's' && spec[0] != 'c') {
+		printf("Error: Bad shared object %s\n", spec);
+		exit(1);
+	}
+	vma->shared = (spec[0] == 's');
+	vma->cow = (spec[0] == 'c');
+	vma->obj = strtoul(spec + 1, NULL, 10);
+}
+
+
+// one zeroed leaf of the radix page table
+struct pte_t* createPageTable() {
+
+	struct pte_t* pagetable = (struct pte_t*) calloc(PT_FANOUT, sizeof(struct pte_t));
+	if(!pagetable) {
+		printf("Error: Out of memory allocating page table\n");
+		exit(1);
+	}
+
+	return pagetable;
+}
+
+/*
+	Page tables are radix trees with PT_FANOUT entries per level: ptLevels - 1
+	levels of child pointers above leaves of ptes, all allocated the first time
+	a page under them is mapped, so memory follows the pages touched rather than
+	the size of the address space. The last leaf walked to is cached per process
+	since consecutive references mostly fall in the same one. Returns NULL for
+	vpages outside the address space, or that have no leaf yet unless alloc.
+*/
+struct pte_t* lookup_pte(struct process* proc, unsigned long vpage, bool alloc) {
+
+	if(vpage >= proc->layout->numVpages) {
+		return NULL;
+	}
+
+	unsigned long tag = vpage >> PT_BITS;
+	if(proc->ptLeaf && proc->ptLeafTag == tag) {
+		return &proc->ptLeaf[vpage & (PT_FANOUT - 1)];
+	}
+
+	void** slot = &proc->pagetable;
+	for(int level = proc->layout->ptLevels - 1; level > 0; level--) {
+		if(!*slot) {
+			if(!alloc) {
+				return NULL;
+			}
+			*slot = calloc(PT_FANOUT, sizeof(void*));
+			if(!*slot) {
+				printf("Error: Out of memory allocating page table\n");
+				exit(1);
+			}
+		}
+		slot = &((void**) *slot)[(vpage >> (level * PT_BITS)) & (PT_FANOUT - 1)];
+	}
+
+	if(!*slot) {
+		if(!alloc) {
+			return NULL;
+		}
+		*slot = createPageTable();
+	}
+
+	proc->ptLeaf = (struct pte_t*) *slot;
+	proc->ptLeafTag = tag;
+	return &proc->ptLeaf[vpage & (PT_FANOUT - 1)];
+}
+
+// level counts down to 1 at the leaves
+void freePageTable(void* node, int level) {
+
+	if(node && level > 1) {
+		for(unsigned long i = 0; i < PT_FANOUT; i++) {
+			freePageTable(((void**) node)[i], level - 1);
+		}
+	}
+	free(node);
+}
+
+struct pstat_t* createPstat() {
+
+	struct pstat_t* pstat = (struct pstat_t*) malloc(sizeof(struct pstat_t));
+	pstat->unmaps = 0;
+	pstat->maps = 0;
+	pstat->ins = 0;
+	pstat->outs = 0;
+	pstat->fins = 0;
+	pstat->fouts = 0;
+	pstat->zeros = 0;
+	pstat->segv = 0;
+	pstat->segprot = 0;
+
+	return pstat;
+}
+
+// flatten the vma_list into a per-vpage table so faults resolve their vma with a single load
+struct vma_t** createVmaTable(struct list* vma_list, unsigned long numVpages) {
+
+	struct vma_t** vmatable = (struct vma_t**) malloc(sizeof(struct vma_t*) * numVpages);
+
+	for(unsigned long i = 0; i < numVpages; i++) {
+		vmatable[i] = NULL;
+	}
+
+	// first matching vma wins, same as the old list walk
+	for(struct node* h = vma_list->head; h != NULL; h = h->next) {
+		struct vma_t* vma = (struct vma_t*) h->val;
+		for(unsigned long v = vma->start_vpage; v <= vma->end_vpage && v < numVpages; v++) {
+			if(vmatable[v] == NULL) {
+				vmatable[v] = vma;
+			}
+		}
+	}
+
+	return vmatable;
+}
+
+unsigned int* createAges(int num_frames) {
+
+	return (unsigned int*) calloc(num_frames, sizeof(unsigned int));
+}
+
+
+/*
+	bitmap functions, 64 frames per word
+*/
+
+unsigned long* createBitmap(int bits) {
+
+	return (unsigned long*) calloc((bits + 63) / 64 + 1, sizeof(unsigned long));
+}
+
+void set_bit(unsigned long* map, int i) {
+
+	map[i / 64] |= 1UL << (i % 64);
+}
+
+void clear_bit(unsigned long* map, int i) {
+
+	map[i / 64] &= ~(1UL << (i % 64));
+}
+
+// clear the R bits of the frames in mask (bitmap word w), in the bitmap and in their ptes
+void clear_referenced(struct sim* sim, int w, unsigned long mask) {
+
+	for(unsigned long bits = sim->refbits[w] & mask; bits; bits &= bits - 1) {
+		sim->frametable[w * 64 + __builtin_ctzl(bits)].pte->referenced = 0;
+	}
+	sim->refbits[w] &= ~mask;
+}
+
+
+/*
+	TLB functions
+*/
+
+struct tlb* createTlb() {
+
+	struct tlb* tlb = (struct tlb*) malloc(sizeof(struct tlb));
+	tlb->sets = TLB_ENTRIES / TLB_WAYS;
+	tlb->ways = TLB_WAYS;
+	tlb->keys = (unsigned long*) calloc(TLB_ENTRIES, sizeof(unsigned long));
+	tlb->ptes = (struct pte_t**) calloc(TLB_ENTRIES, sizeof(struct pte_t*));
+	tlb->stamps = (unsigned long*) calloc(TLB_ENTRIES, sizeof(unsigned long));
+	tlb->clock = 0;
+	tlb->seed = 0x9e3779b97f4a7c15UL;
+	tlb->hits = 0;
+	tlb->misses = 0;
+	tlb->flushes = 0;
+	tlb->shootdowns = 0;
+	return tlb;
+}
+
+void freeTlb(struct tlb* tlb) {
+
+	free(tlb->keys);
+	free(tlb->ptes);
+	free(tlb->stamps);
+	free(tlb);
+}
+
+// nonzero, and with pids under MAX_PROCS at most 1 << TLB_HUGE_SHIFT, below every huge key
+unsigned long tlb_key(unsigned int pid, unsigned long vpage) {
+
+	return (((unsigned long) pid << MAX_VPAGE_BITS) | vpage) + 1;
+}
+
+// one entry for the whole huge range of class h around vpage
+unsigned long tlb_huge_key(unsigned int pid, unsigned long vpage, int h) {
+
+	return tlb_key(pid, vpage & ~(HUGE_PAGES[h] - 1)) | (unsigned long) h << TLB_HUGE_SHIFT;
+}
+
+/*
+	The set is picked by the low bits of tag, the vpage for base entries and
+	the huge page number for huge ones, as hardware indexes by virtual address
+*/
+bool tlb_lookup(struct tlb* tlb, unsigned long tag, unsigned long key, struct pte_t** pte) {
+
+	int base = (int) (tag & (tlb->sets - 1)) * tlb->ways;
+
+	for(int i = base; i < base + tlb->ways; i++) {
+		if(tlb->keys[i] == key) {
+			if(TLB_POLICY == 'l') {
+				tlb->stamps[i] = ++tlb->clock;
+			}
+			*pte = tlb->ptes[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// fill after a miss: an invalid way if there is one, otherwise the policy's victim
+void tlb_fill(struct tlb* tlb, unsigned long tag, unsigned long key, struct pte_t* pte) {
+
+	int base = (int) (tag & (tlb->sets - 1)) * tlb->ways;
+	int victim = base;
+
+	for(int i = base; i < base + tlb->ways; i++) {
+		if(tlb->keys[i] == 0) {
+			victim = i;
+			break;
+		}
+		if(tlb->stamps[i] < tlb->stamps[victim]) {
+			victim = i;
+		}
+	}
+
+	if(tlb->keys[victim] != 0 && TLB_POLICY == 'r') {
+		tlb->seed ^= tlb->seed << 13;
+		tlb->seed ^= tlb->seed >> 7;
+		tlb->seed ^= tlb->seed << 17;
+		victim = base + (int) (tlb->seed % tlb->ways);
+	}
+
+	tlb->keys[victim] = key;
+	tlb->ptes[victim] = pte;
+	tlb->stamps[victim] = ++tlb->clock;
+}
+
+// cache the translation of a present page, as a huge entry if it is part of a huge mapping
+void tlb_fill_pte(struct sim* sim, struct process* proc, unsigned long vpage, struct pte_t* pte) {
+
+	if(pte->huge) {
+		tlb_fill(sim->tlb, vpage >> HUGE_SHIFT[pte->huge], tlb_huge_key(proc->pid, vpage, pte->huge), NULL);
+	} else {
+		tlb_fill(sim->tlb, vpage, tlb_key(proc->pid, vpage), pte);
+	}
+}
+
+void tlb_invalidate(struct tlb* tlb, unsigned long tag, unsigned long key) {
+
+	int base = (int) (tag & (tlb->sets - 1)) * tlb->ways;
+
+	for(int i = base; i < base + tlb->ways; i++) {
+		if(tlb->keys[i] == key) {
+			tlb->keys[i] = 0;
+			tlb->shootdowns++;
+			return;
+		}
+	}
+}
+
+void tlb_flush(struct tlb* tlb) {
+
+	memset(tlb->keys, 0, sizeof(unsigned long) * tlb->sets * tlb->ways);
+	tlb->flushes++;
+}
+
+
+/*
+	singly-linked list functions
+*/
+
+struct list* createList() {
+
+	struct list* l = (struct list*) malloc(sizeof(struct list));
+	l->tail = NULL;
+	l->head = NULL;
+	l->size = 0;
+	return l;
+}
+
+void add(struct list* l, void* v) {
+
+	struct node* n = (struct node*) malloc(sizeof(struct node));
+	n->val = v;
+	n->next = NULL;
+
+	if(l->size == 0) {
+		l->head = n;
+	} else {
+		l->tail->next = n;
+	}
+
+	l->tail = n;
+	l->size++;
+}
+
+// confirm the vpage from the instruction is a valid page in the vma of the current process
+struct vma_t* find_vma(struct process* proc, unsigned long vpage) {
+
+	if(vpage >= proc->layout->numVpages) {
+		return NULL;
+	}
+
+	if(proc->vmatable) {
+		return proc->vmatable[vpage];
+	}
+
+	struct vma_t* vma = NULL;
+	vma_tree_find(proc, 0, proc->vma_list->size - 1, vpage, &vma);
+	return vma;
+}
+
+
+/*
+	pagemap functions
+*/
+
+struct pagemap* createPageMap() {
+
+	struct pagemap* map = (struct pagemap*) malloc(sizeof(struct pagemap));
+	map->cap = 1024;
+	map->count = 0;
+	map->keys = (unsigned long*) malloc(sizeof(unsigned long) * map->cap);
+	map->vals = (int*) malloc(sizeof(int) * map->cap);
+	memset(map->keys, 0xff, sizeof(unsigned long) * map->cap);
+	return map;
+}
+
+// dense index of (pid, vpage), numbering pages in the order they are first seen
+int pagemap_index(struct pagemap* map, unsigned int pid, unsigned long vpage) {
+
+	unsigned long key = ((unsigned long) pid << MAX_VPAGE_BITS) | vpage;
+	size_t mask = map->cap - 1;
+	size_t h = (key * 0x9e3779b97f4a7c15UL) >> 32;
+
+	for(size_t i = h & mask; ; i = (i + 1) & mask) {
+		if(map->keys[i] == key) {
+			return map->vals[i];
+		}
+		if(map->keys[i] == ULONG_MAX) {
+			map->keys[i] = key;
+			map->vals[i] = map->count++;
+			break;
+		}
+	}
+	int index = map->count - 1;
+
+	// keep the load under 1/2
+	if(2 * map->count > map->cap) {
+		unsigned long* keys = map->keys;
+		int* vals = map->vals;
+		size_t cap = map->cap;
+
+		map->cap *= 2;
+		mask = map->cap - 1;
+		map->keys = (unsigned long*) malloc(sizeof(unsigned long) * map->cap);
+		map->vals = (int*) malloc(sizeof(int) * map->cap);
+		if(!map->keys || !map->vals) {
+			printf("Error: Out of memory tracking pages\n");
+			exit(1);
+		}
+		memset(map->keys, 0xff, sizeof(unsigned long) * map->cap);
+		for(size_t j = 0; j < cap; j++) {
+			if(keys[j] == ULONG_MAX) {
+				continue;
+			}
+			size_t i = ((keys[j] * 0x9e3779b97f4a7c15UL) >> 32) & mask;
+			while(map->keys[i] != ULONG_MAX) {
+				i = (i + 1) & mask;
+			}
+			map->keys[i] = keys[j];
+			map->vals[i] = vals[j];
+		}
+		free(keys);
+		free(vals);
+	}
+
+	return index;
+}
+
+void freePageMap(struct pagemap* map) {
+
+	free(map->keys);
+	free(map->vals);
+	free(map);
+}
+
+/*
+	history functions
+*/
+
+struct history* createHistory(int cap) {
+
+	struct history* h = (struct history*) malloc(sizeof(struct history));
+	size_t buckets = 1;
+	while(buckets < (size_t) cap) {
+		buckets *= 2;
+	}
+
+	h->keys = (unsigned long*) malloc(sizeof(unsigned long) * cap);
+	h->frames = (int*) malloc(sizeof(int) * cap);
+	h->prev = (int*) malloc(sizeof(int) * cap);
+	h->next = (int*) malloc(sizeof(int) * cap);
+	h->chain = (int*) malloc(sizeof(int) * cap);
+	h->lists = (unsigned char*) malloc(cap);
+	h->flags = (unsigned char*) malloc(cap);
+	h->buckets = (int*) malloc(sizeof(int) * buckets);
+	h->mask = buckets - 1;
+	if(!h->keys || !h->frames || !h->prev || !h->next || !h->chain || !h->lists || !h->flags || !h->buckets) {
+		printf("Error: Out of memory tracking pages\n");
+		exit(1);
+	}
+
+	for(int i = 0; i < cap; i++) {
+		h->chain[i] = (i + 1 < cap) ? i + 1 : -1;
+	}
+	h->freeHead = 0;
+	for(size_t i = 0; i < buckets; i++) {
+		h->buckets[i] = -1;
+	}
+	for(int l = 0; l < 4; l++) {
+		h->head[l] = h->tail[l] = -1;
+		h->size[l] = 0;
+	}
+	return h;
+}
+
+void freeHistory(struct history* h) {
+
+	free(h->keys);
+	free(h->frames);
+	free(h->prev);
+	free(h->next);
+	free(h->chain);
+	free(h->lists);
+	free(h->flags);
+	free(h->buckets);
+	free(h);
+}
+
+unsigned long page_key(unsigned int pid, unsigned long vpage) {
+
+	return ((unsigned long) pid << MAX_VPAGE_BITS) | vpage;
+}
+
+static inline size_t hist_bucket(struct history* h, unsigned long key) {
+
+	return ((key * 0x9e3779b97f4a7c15UL) >> 32) & h->mask;
+}
+
+// entry of key, -1 if it has none
+int hist_find(struct history* h, unsigned long key) {
+
+	for(int e = h->buckets[hist_bucket(h, key)]; e != -1; e = h->chain[e]) {
+		if(h->keys[e] == key) {
+			return e;
+		}
+	}
+	return -1;
+}
+
+// a new entry for key, on no list yet
+int hist_add(struct history* h, unsigned long key, int frame) {
+
+	int e = h->freeHead;
+	if(e == -1) {
+		printf("Error: Page history pool exhausted\n");
+		exit(1);
+	}
+	h->freeHead = h->chain[e];
+
+	size_t b = hist_bucket(h, key);
+	h->keys[e] = key;
+	h->frames[e] = frame;
+	h->lists[e] = HIST_NONE;
+	h->flags[e] = 0;
+	h->chain[e] = h->buckets[b];
+	h->buckets[b] = e;
+	return e;
+}
+
+// take e off its list and out of the hash, and give it back to the pool
+void hist_drop(struct history* h, int e) {
+
+	hist_unlink(h, e);
+	int* p = &h->buckets[hist_bucket(h, h->keys[e])];
+	while(*p != e) {
+		p = &h->chain[*p];
+	}
+	*p = h->chain[e];
+	h->chain[e] = h->freeHead;
+	h->freeHead = e;
+}
+
+// move e to another key, which must have no entry
+void hist_rekey(struct history* h, int e, unsigned long key) {
+
+	int* p = &h->buckets[hist_bucket(h, h->keys[e])];
+	while(*p != e) {
+		p = &h->chain[*p];
+	}
+	*p = h->chain[e];
+
+	size_t b = hist_bucket(h, key);
+	h->keys[e] = key;
+	h->chain[e] = h->buckets[b];
+	h->buckets[b] = e;
+}
+
+// put e on list l just before entry at, or at the tail if at is -1
+void hist_insert(struct history* h, int l, int e, int at) {
+
+	int prev = (at == -1) ? h->tail[l] : h->prev[at];
+	h->prev[e] = prev;
+	h->next[e] = at;
+	if(prev == -1) {
+		h->head[l] = e;
+	} else {
+		h->next[prev] = e;
+	}
+	if(at == -1) {
+		h->tail[l] = e;
+	} else {
+		h->prev[at] = e;
+	}
+	h->lists[e] = l;
+	h->size[l]++;
+}
+
+void hist_unlink(struct history* h, int e) {
+
+	int l = h->lists[e];
+	if(l == HIST_NONE) {
+		return;
+	}
+	if(h->prev[e] == -1) {
+		h->head[l] = h->next[e];
+	} else {
+		h->next[h->prev[e]] = h->next[e];
+	}
+	if(h->next[e] == -1) {
+		h->tail[l] = h->prev[e];
+	} else {
+		h->prev[h->next[e]] = h->prev[e];
+	}
+	h->lists[e] = HIST_NONE;
+	h->size[l]--;
+}
+
+// entry after e on its list, wrapping round to the head
+int hist_next(struct history* h, int e) {
+
+	return (h->next[e] != -1) ? h->next[e] : h->head[h->lists[e]];
+}
+
+/*
+	Random value generator functions
+*/
+
+int myrandom(struct sim* sim, int size) {
+
+	if(RAND_SEEDED) {
+		return (int) rng_below(&sim->rng, size);
+	}
+
+	if(sim->ofs == randCount) {
+		sim->ofs = 0;
+	}
+
+	return (randVals[sim->ofs++] % size);
+}
+
+void createRandArray(char* filename) {
+
+	FILE* fp = fopen(filename,"r");
+	if(!fp) {
+		printf("Error: Could not open rfile\n");
+		exit(1);
+	}
+
+	char line[15];
+	int i = 0;
+	fgets(line, 15, fp);
+	randCount = atoi(line);
+	randVals = (int*) malloc(sizeof(int) * randCount); 
+	
+	while(i < randCount && fgets(line, 15, fp)) {
+		randVals[i] = atoi(line);
+		i++;
+	}
+
+	fclose(fp);
+}
+
+// xoshiro256** (Blackman and Vigna), seeded through splitmix64
+void rng_seed(struct rng* rng, unsigned long seed) {
+
+	for(int i = 0; i < 4; i++) {
+		unsigned long z = (seed += 0x9e3779b97f4a7c15UL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+		rng->s[i] = z ^ (z >> 31);
+	}
+}
+
+static inline unsigned long rotl(unsigned long x, int k) {
+
+	return (x << k) | (x >> (64 - k));
+}
+
+unsigned long rng_next(struct rng* rng) {
+
+	unsigned long* s = rng->s;
+	unsigned long result = rotl(s[1] * 5, 7) * 9;
+	unsigned long t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+// uniform in [0, n) without modulo bias, Lemire's multiply and reject
+unsigned long rng_below(struct rng* rng, unsigned long n) {
+
+	unsigned __int128 m = (unsigned __int128) rng_next(rng) * n;
+	unsigned long low = (unsigned long) m;
+	if(low < n) {
+		unsigned long threshold = -n % n;
+		while(low < threshold) {
+			m = (unsigned __int128) rng_next(rng) * n;
+			low = (unsigned long) m;
+		}
+	}
+	return (unsigned long) (m >> 64);
+}
+
+// uniform in [0, 1)
+double rng_double(struct rng* rng) {
+
+	return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+
+/*
+	Synthetic trace functions
+*/
+
+/*
+	-g pattern[+pattern...][,key=value...]. Patterns are uniform, zipf, scan
+	(each process sweeps its whole vma) and loop (each process cycles through
+	its first loop pages); several take turns every phase references. Keys:
+	n instructions (1000000), procs (4), pages per process (1024), writes
+	(0.3), theta (0.99), loop (pages / 2), phase (100000), switch, the mean
+	references between context switches (100), and seed (1).
+*/
+struct trace* openGenerator(char* spec) {
+
+	struct generator* g = (struct generator*) malloc(sizeof(struct generator));
+	parseGenerator(g, spec);
+
+	g->made = 0;
+	g->current = -1;
+	g->cursors = (unsigned long*) calloc(g->procs, sizeof(unsigned long));
+	g->head = g->tail = g->full = 0;
+	g->offset = 0;
+	g->stop = false;
+	g->ring = (struct inst*) malloc(sizeof(struct inst) * INST_CHUNK * GEN_SLOTS);
+	if(!g->cursors || !g->ring) {
+		printf("Error: Out of memory for the generator\n");
+		exit(1);
+	}
+
+	// Gray et al., "Quickly generating billion-record synthetic databases"
+	g->zetan = 0;
+	if(strchr(g->patterns, 'z')) {
+		for(unsigned long i = 1; i <= g->pages; i++) {
+			g->zetan += 1 / pow(i, g->theta);
+		}
+	}
+	g->zeta2 = 1 + pow(0.5, g->theta);
+	g->alpha = 1 / (1 - g->theta);
+	g->eta = (1 - pow(2.0 / g->pages, 1 - g->theta)) / (1 - g->zeta2 / g->zetan);
+
+	struct layout* layout = (struct layout*) malloc(sizeof(struct layout));
+	layout->nextUse = NULL;
+	layout->procCount = g->procs;
+	layout->procs = (struct process*) malloc(sizeof(struct process) * g->procs);
+	for(int i = 0; i < g->procs; i++) {
+		layout->procs[i].pid = i;
+		layout->procs[i].vma_list = createList();
+		add(layout->procs[i].vma_list, (void*) createVma(0, g->pages - 1, 0, 0, 0));
+	}
+	createVmaLookups(layout);
+
+	struct trace* tr = (struct trace*) malloc(sizeof(struct trace));
+	tr->fp = NULL;
+	tr->buf = NULL;
+	tr->len = 0;
+	tr->binary = false;
+	tr->cur = tr->end = NULL;
+	tr->layout = layout;
+	tr->gen = g;
+
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->filled, NULL);
+	pthread_cond_init(&g->drained, NULL);
+	if(pthread_create(&g->thread, NULL, runGenerator, g) != 0) {
+		printf("Error: Could not start the generator\n");
+		exit(1);
+	}
+	return tr;
+}
+
+void parseGenerator(struct generator* g, char* spec) {
+
+	g->patternCount = 0;
+	g->count = 1000000;
+	g->procs = 4;
+	g->pages = 1024;
+	g->writes = 0.3;
+	g->theta = 0.99;
+	g->loop = 0;
+	g->phase = 100000;
+	g->switchEvery = 100;
+	unsigned long seed = 1;
+
+	char* save;
+	char* patterns = strtok_r(spec, ",", &save);
+	for(char* p = strtok_r(NULL, ",", &save); p != NULL; p = strtok_r(NULL, ",", &save)) {
+		char* eq = strchr(p, '=');
+		if(!eq) {
+			printf("Illegal generator option %s\n", p);
+			exit(1);
+		}
+		*eq++ = '\0';
+		if(strcmp(p, "n") == 0) {
+			g->count = strtoul(eq, NULL, 10);
+		} else if(strcmp(p, "procs") == 0) {
+			g->procs = atoi(eq);
+		} else if(strcmp(p, "pages") == 0) {
+			g->pages = strtoul(eq, NULL, 10);
+		} else if(strcmp(p, "writes") == 0) {
+			g->writes = atof(eq);
+		} else if(strcmp(p, "theta") == 0) {
+			g->theta = atof(eq);
+		} else if(strcmp(p, "loop") == 0) {
+			g->loop = strtoul(eq, NULL, 10);
+		} else if(strcmp(p, "phase") == 0) {
+			g->phase = strtoul(eq, NULL, 10);
+		} else if(strcmp(p, "switch") == 0) {
+			g->switchEvery = strtoul(eq, NULL, 10);
+		} else if(strcmp(p, "seed") == 0) {
+			seed = strtoul(eq, NULL, 10);
+		} else {
+			printf("Illegal generator option %s\n", p);
+			exit(1);
+		}
+	}
+
+	char* psave;
+	for(char* p = patterns ? strtok_r(patterns, "+", &psave) : NULL; p != NULL; p = strtok_r(NULL, "+", &psave)) {
+		if(g->patternCount == GEN_PATTERNS - 1 || (strcmp(p, "uniform") != 0 && strcmp(p, "zipf") != 0 &&
+		   strcmp(p, "scan") != 0 && strcmp(p, "loop") != 0)) {
+			printf("Illegal generator pattern %s\n", p);
+			exit(1);
+		}
+		g->patterns[g->patternCount++] = p[0];
+	}
+	g->patterns[g->patternCount] = '\0';
+
+	g->loop = g->loop ? g->loop : (g->pages + 1) / 2;
+	if(g->patternCount == 0 || g->procs < 1 || g->procs > MAX_PROCS || g->pages < 2 || g->pages > 1UL << MAX_VPAGE_BITS ||
+	   g->loop > g->pages || g->writes < 0 || g->writes > 1 || g->theta <= 0 || g->theta >= 1 ||
+	   g->phase == 0 || g->switchEvery == 0) {
+		printf("Illegal generator options\n");
+		exit(1);
+	}
+	rng_seed(&g->rng, seed);
+}
+
+// stop the producer, which may be waiting for a slot to drain
+void closeGenerator(struct generator* g) {
+
+	pthread_mutex_lock(&g->lock);
+	g->stop = true;
+	pthread_cond_signal(&g->drained);
+	pthread_mutex_unlock(&g->lock);
+	pthread_join(g->thread, NULL);
+
+	pthread_mutex_destroy(&g->lock);
+	pthread_cond_destroy(&g->filled);
+	pthread_cond_destroy(&g->drained);
+	free(g->ring);
+	free(g->cursors);
+	free(g);
+}
+
+// producer: fill free slots until the trace is done, ending with an empty slot
+void* runGenerator(void* arg) {
+
+	struct generator* g = (struct generator*) arg;
+	size_t len;
+
+	do {
+		pthread_mutex_lock(&g->lock);
+		while(g->full == GEN_SLOTS && !g->stop) {
+			pthread_cond_wait(&g->drained, &g->lock);
+		}
+		bool stop = g->stop;
+		pthread_mutex_unlock(&g->lock);
+		if(stop) {
+			break;
+		}
+
+		// only the producer touches a slot until it is counted as full
+		len = gen_fill(g, g->ring + (size_t) g->tail * INST_CHUNK, INST_CHUNK);
+
+		pthread_mutex_lock(&g->lock);
+		g->lens[g->tail] = len;
+		g->tail = (g->tail + 1) % GEN_SLOTS;
+		g->full++;
+		pthread_cond_signal(&g->filled);
+		pthread_mutex_unlock(&g->lock);
+	} while(len > 0);
+
+	return NULL;
+}
+
+size_t gen_fill(struct generator* g, struct inst* insts, size_t max) {
+
+	size_t n = 0;
+	for(; n < max && g->made < g->count; n++, g->made++) {
+		if(g->current == -1 || rng_below(&g->rng, g->switchEvery) == 0) {
+			g->current = rng_below(&g->rng, g->procs);
+			insts[n].op = 'c';
+			insts[n].vpage = g->current;
+			continue;
+		}
+		insts[n].op = (rng_double(&g->rng) < g->writes) ? 'w' : 'r';
+		insts[n].vpage = gen_page(g);
+	}
+	return n;
+}
+
+// consumer side of read_instructions: blocks until there is a full slot or the end
+size_t gen_read(struct generator* g, struct inst* insts, size_t max) {
+
+	size_t n = 0;
+	while(n < max) {
+		pthread_mutex_lock(&g->lock);
+		while(g->full == 0) {
+			pthread_cond_wait(&g->filled, &g->lock);
+		}
+		size_t len = g->lens[g->head];
+		pthread_mutex_unlock(&g->lock);
+
+		// the end stays in the ring, so later reads see it too
+		if(len == 0) {
+			break;
+		}
+
+		size_t take = (len - g->offset < max - n) ? len - g->offset : max - n;
+		memcpy(insts + n, g->ring + (size_t) g->head * INST_CHUNK + g->offset, sizeof(struct inst) * take);
+		n += take;
+		g->offset += take;
+
+		if(g->offset == len) {
+			pthread_mutex_lock(&g->lock);
+			g->head = (g->head + 1) % GEN_SLOTS;
+			g->full--;
+			g->offset = 0;
+			pthread_cond_signal(&g->drained);
+			pthread_mutex_unlock(&g->lock);
+		}
+	}
+	return n;
+}
+
+// vpage of the current process's next reference, from the pattern of the current phase
+unsigned long gen_page(struct generator* g) {
+
+	unsigned long* cursor = &g->cursors[g->current];
+
+	switch(g->patterns[(g->made / g->phase) % g->patternCount]) {
+		case 'z':
+			return gen_zipf(g);
+		case 's':
+			return (*cursor)++ % g->pages;
+		case 'l':
+			return (*cursor)++ % g->loop;
+		default:
+			return rng_below(&g->rng, g->pages);
 	}
 }
 
+// Zipf rank in [0, pages), rank 0 the most popular
+unsigned long gen_zipf(struct generator* g) {
 
-bool get_next_instruction(FILE* fp) {
-	
-	char line[100];
-	if(!fgets(line, 100, fp)) {
-		return false;
+	double u = rng_double(&g->rng);
+	double uz = u * g->zetan;
+
+	if(uz < 1) {
+		return 0;
 	}
+	if(uz < g->zeta2) {
+		return 1;
+	}
+	unsigned long rank = (unsigned long) (g->pages * pow(g->eta * u - g->eta + 1, g->alpha));
+	return (rank < g->pages) ? rank : g->pages - 1;
+}
 
-	if(line[0] == '#') {
-		return false;
+
+/*
+	Event trace (-oO). Instructions and the events they cause are printed as
+	text on sim->out, or with -l written to a binary log that mmulog turns
+	back into the same text.
+*/
+
+void log_inst(struct sim* sim, char op, unsigned long operand) {
+
+	if(sim->log) {
+		int opcode = (int) (strchr(TRACE_OPS, op) - TRACE_OPS);
+		if(operand <= OPERAND_MASK) {
+			out_byte(sim->log, (opcode << OP_SHIFT) | (int) operand);
+		} else {
+			out_byte(sim->log, (OP_ESCAPE << OP_SHIFT) | opcode);
+			out_varint(sim->log, operand);
+		}
+		return;
 	}
 
-	char* op = strtok(line, delims);
-	operation = op[0];
-	curr_vpage = atoi(strtok(NULL, delims));
-	return true;
+	out_ulong(sim->out, sim->instCount);
+	out_str(sim->out, ": ==> ");
+	out_byte(sim->out, op);
+	out_byte(sim->out, ' ');
+	out_ulong(sim->out, operand);
+	out_byte(sim->out, '\n');
 }
 
+// ev is an EV_* code, a and b its operands if EVENT_ARGS says it has them
+void log_event(struct sim* sim, int ev, unsigned long a, unsigned long b) {
 
-void createProcArray(FILE* fp) {
+	if(sim->log) {
+		out_byte(sim->log, (OP_ESCAPE << OP_SHIFT) | (EV_BASE + ev));
+		if(EVENT_ARGS[ev] > 0) out_varint(sim->log, a);
+		if(EVENT_ARGS[ev] > 1) out_varint(sim->log, b);
+		return;
+	}
 
-	char line[100];
-	fgets(line, 100, fp); fgets(line, 100, fp); fgets(line, 100, fp); fgets(line, 100, fp);
-	procCount = atoi(strtok(line, delims));
-	procArray = (struct process*) malloc(sizeof(struct process) * procCount);
-	int vmaCount = 0;
+	out_str(sim->out, "  ");
+	out_str(sim->out, EVENT_NAMES[ev]);
+	if(EVENT_ARGS[ev] > 0) {
+		out_byte(sim->out, ' ');
+		out_ulong(sim->out, a);
+	}
+	if(EVENT_ARGS[ev] > 1) {
+		out_byte(sim->out, ':');
+		out_ulong(sim->out, b);
+	}
+	out_byte(sim->out, '\n');
+}
 
-	for(int i = 0; i < procCount; i++) {
+void openEventLog(struct sim* sim, const char* filename) {
 
-		fgets(line, 20, fp); fgets(line, 20, fp); fgets(line, 20, fp);
-		vmaCount = atoi(strtok(line, delims));
-		procArray[i].pid = i; 
-		procArray[i].pagetable = createPageTable();
-		procArray[i].vma_list = createList();
-		procArray[i].pstat = createPstat();
-		procArray[i].ages = createAges();
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		printf("Error: Could not open event log\n");
+		exit(1);
+	}
+	sim->log = createOutbuf(fd, true);
+	out_str(sim->log, LOG_MAGIC);
+}
 
-		// add vma's to process vma_list
-		for(int j = 0; j < vmaCount; j++) {
 
-			fgets(line, 20, fp);
-			struct vma_t* vma = (struct vma_t*) malloc(sizeof(struct vma_t));
-			vma->start_vpage = atoi(strtok(line, delims));
-			vma->end_vpage = atoi(strtok(NULL, delims));
-			vma->write_protect = atoi(strtok(NULL, delims));
-			vma->filemapped = atoi(strtok(NULL, delims));
-			add(procArray[i].vma_list, (void*) vma);
-		}
+/*
+	Checkpoint functions
+*/
+
+/*
+	The checkpoint is written by a forked child from its copy-on-write image
+	of the sim, so the run goes on while the file is written. The child writes
+	<file>.tmp and renames it over <file>, which leaves the last complete
+	checkpoint in place if either process is killed. pos is where the trace
+	resumes, see runCheckpointed.
+*/
+void writeCheckpoint(struct sim* sim, long pos) {
+
+	// one writer at a time, the next checkpoint replaces this one anyway
+	waitCheckpoint(sim);
+	out_flush(sim->out);
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if(pid < 0) {
+		printf("Error: Could not fork checkpoint writer\n");
+		exit(1);
+	}
+	if(pid > 0) {
+		sim->ckptWriter = pid;
+		return;
+	}
+
+	char tmp[strlen(CKPT_FILE) + 5];
+	sprintf(tmp, "%s.tmp", CKPT_FILE);
+	FILE* fp = fopen(tmp, "wb");
+	if(!fp) {
+		_exit(1);
 	}
 
-	fgets(line, 100, fp);
+	struct ckpt ck = { fp, false };
+	ckpt_io(&ck, (void*) CKPT_MAGIC, sizeof(CKPT_MAGIC) - 1);
+	ckpt_io(&ck, &pos, sizeof(pos));
+	serializeSim(&ck, sim);
+
+	bool failed = ferror(fp);
+	if(fclose(fp) != 0 || failed || rename(tmp, CKPT_FILE) != 0) {
+		_exit(1);
+	}
+	_exit(0);
 }
 
+// reap the checkpoint writer, if there is one
+void waitCheckpoint(struct sim* sim) {
 
-struct pte_t* createPageTable() {
-	
-	struct pte_t* pagetable = (struct pte_t*) malloc(sizeof(struct pte_t) * NUM_VPAGES);
-	// initialize each pte to 0 before instruction sim starts
-	for(int i = 0; i < NUM_VPAGES; i++) {
-		pagetable[i].present = 0;
-		pagetable[i].write_protect = 0;
-		pagetable[i].modified = 0;
-		pagetable[i].referenced = 0;
-		pagetable[i].pagedout = 0;
-		pagetable[i].filemapped = 0;
-		pagetable[i].frame = 0;
+	if(!sim->ckptWriter) {
+		return;
 	}
 
-	return pagetable;
+	int status;
+	if(waitpid(sim->ckptWriter, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("Error: Could not write checkpoint\n");
+		exit(1);
+	}
+	sim->ckptWriter = 0;
 }
 
-struct pstat_t* createPstat() {
+// load a checkpoint into a fresh sim, returns where the trace resumes
+long readCheckpoint(struct sim* sim, const char* filename) {
 
-	struct pstat_t* pstat = (struct pstat_t*) malloc(sizeof(struct pstat_t));
-	pstat->unmaps = 0;
-	pstat->maps = 0;
-	pstat->ins = 0;
-	pstat->outs = 0;
-	pstat->fins = 0;
-	pstat->fouts = 0;
-	pstat->zeros = 0;
-	pstat->segv = 0;
-	pstat->segprot = 0;
+	FILE* fp = fopen(filename, "rb");
+	if(!fp) {
+		printf("Error: Could not open checkpoint\n");
+		exit(1);
+	}
 
-	return pstat;
-}
+	char magic[sizeof(CKPT_MAGIC) - 1];
+	if(fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, CKPT_MAGIC, sizeof(magic)) != 0) {
+		printf("Error: Not a checkpoint\n");
+		exit(1);
+	}
 
-unsigned int* createAges() {
+	struct ckpt ck = { fp, true };
+	long pos;
+	ckpt_io(&ck, &pos, sizeof(pos));
+	serializeSim(&ck, sim);
+	fclose(fp);
+	return pos;
+}
 
-	unsigned int* ages = (unsigned int*) malloc(sizeof(unsigned int) * NUM_VPAGES);
+/*
+	Identifies the trace a checkpoint belongs to, so one is not resumed over
+	another: every vma of the header, then the input's size and first
+	CKPT_PROBE bytes, or the -g spec of a generated trace. OPT has the whole
+	trace loaded, even from a pipe, and hashes all n instructions too.
+*/
+unsigned long traceFingerprint(struct trace* tr, const struct inst* insts, size_t n) {
+
+	unsigned long h = 0xcbf29ce484222325UL;
+	for(int i = 0; i < tr->layout->procCount; i++) {
+		for(struct node* node = tr->layout->procs[i].vma_list->head; node != NULL; node = node->next) {
+			struct vma_t* vma = (struct vma_t*) node->val;
+			unsigned long v[] = { i, vma->start_vpage, vma->end_vpage, vma->write_protect, vma->filemapped,
+				vma->huge, vma->shared, vma->cow, vma->obj };
+			h = hash_bytes(h, v, sizeof(v));
+		}
+	}
 
-	for(int i = 0; i < NUM_VPAGES; i++) {
-		ages[i] = 0;
+	struct stat st;
+	if(tr->gen) {
+		h = hash_bytes(h, GENERATOR, strlen(GENERATOR));
+	} else if(tr->buf) {
+		h = hash_bytes(h, &tr->len, sizeof(tr->len));
+		h = hash_bytes(h, tr->buf, (tr->len < CKPT_PROBE) ? tr->len : CKPT_PROBE);
+	} else if(fstat(fileno(tr->fp), &st) == 0 && S_ISREG(st.st_mode)) {
+		// pread leaves the stream's position alone
+		char* probe = (char*) malloc(CKPT_PROBE);
+		ssize_t len = pread(fileno(tr->fp), probe, CKPT_PROBE, 0);
+		if(len < 0) {
+			printf("Error: Could not read the trace\n");
+			exit(1);
+		}
+		h = hash_bytes(h, &st.st_size, sizeof(st.st_size));
+		h = hash_bytes(h, probe, len);
+		free(probe);
 	}
 
-	return ages;
+	for(size_t i = 0; i < n; i++) {
+		unsigned long v[] = { insts[i].op, insts[i].vpage };
+		h = hash_bytes(h, v, sizeof(v));
+	}
+	return h;
 }
 
+// FNV-1a over size bytes at p, continuing from h
+unsigned long hash_bytes(unsigned long h, const void* p, size_t size) {
+
+	const unsigned char* b = (const unsigned char*) p;
+	for(size_t i = 0; i < size; i++) {
+		h = (h ^ b[i]) * 0x100000001b3UL;
+	}
+	return h;
+}
 
 /*
-	singly-linked list functions
+	Reads or writes everything a run mutates, the same fields in the same
+	order both ways. Arrays are stored raw; pointers into the page tables
+	(frame and TLB ptes) are rebuilt from the pid and vpage once the page
+	tables are loaded. The options and the trace's fingerprint come first,
+	and a checkpoint from another configuration or trace is refused.
 */
+void serializeSim(struct ckpt* ck, struct sim* sim) {
+
+	#define CKPT(x) ckpt_io(ck, &(x), sizeof(x))
+
+	unsigned long config[] = { sim->pager, sim->num_frames, sim->layout->procCount, sim->layout->numVpages,
+		TLB_ENTRIES, TLB_WAYS, TLB_POLICY, TLB_ASID, HUGE_PAGES[1], HUGE_PAGES[2], KHUGEPAGED, WS_TAU,
+		KSWAPD_LOW, KSWAPD_HIGH, READAHEAD_MAX, SNAP_INTERVAL, randCount, RAND_SEEDED, RAND_SEED,
+		NUMA_NODES, NUMA_POLICY, NUMA_REMOTE_COST, sim->layout->fingerprint };
+	unsigned long saved[sizeof(config) / sizeof(config[0])];
+	memcpy(saved, config, sizeof(config));
+	CKPT(saved);
+	if(memcmp(saved, config, sizeof(config)) != 0) {
+		printf("Error: Checkpoint is from a different trace or options\n");
+		exit(1);
+	}
 
-struct list* createList() {
+	CKPT(sim->freeFrame);
+	CKPT(sim->freeCount);
+	CKPT(sim->frameInd);
+	CKPT(sim->pagerOn);
+	CKPT(sim->instCount);
+	CKPT(sim->ctxSwitches);
+	CKPT(sim->cost);
+	CKPT(sim->ofs);
+	CKPT(sim->rng);
+	CKPT(sim->requests);
+	CKPT(sim->clockHand);
+	CKPT(sim->lruHead);
+	CKPT(sim->lruTail);
+	CKPT(sim->optHeapSize);
+	CKPT(sim->faultEntry);
+	CKPT(sim->target);
+	CKPT(sim->arcDiscard);
+	CKPT(sim->handHot);
+	CKPT(sim->handCold);
+	CKPT(sim->handTest);
+	CKPT(sim->countHot);
+	CKPT(sim->countCold);
+	CKPT(sim->countTest);
+	CKPT(sim->ghostHits);
+	CKPT(sim->faults);
+	CKPT(sim->hugeMaps);
+	CKPT(sim->splits);
+	CKPT(sim->collapses);
+	CKPT(sim->popPid);
+	CKPT(sim->popBase);
+	CKPT(sim->popSize);
+	CKPT(sim->popAborted);
+	CKPT(sim->kswapdWakeups);
+	CKPT(sim->directReclaims);
+	CKPT(sim->kswapdStat);
+	CKPT(sim->raPages);
+	CKPT(sim->raHits);
+	CKPT(sim->raWasted);
+	CKPT(sim->shareMaps);
+	CKPT(sim->cowCopies);
+	CKPT(sim->cowReuses);
+	CKPT(sim->sharedPtes);
+	CKPT(sim->sharedPeak);
+	CKPT(sim->nextSnap);
+	CKPT(sim->localRefs);
+	CKPT(sim->remoteRefs);
+	CKPT(sim->fallbacks);
+
+	int current = sim->current ? (int) (sim->current - sim->procArray) : -1;
+	CKPT(current);
+	if(current >= sim->layout->procCount) {
+		printf("Error: Corrupt checkpoint\n");
+		exit(1);
+	}
+	sim->current = (current < 0) ? NULL : &sim->procArray[current];
+
+	int frames = sim->num_frames;
+	size_t words = (frames + 63) / 64 + 1; // see createBitmap
+	ckpt_io(ck, sim->frametable, sizeof(struct frame_t) * frames);
+	ckpt_io(ck, sim->refbits, sizeof(unsigned long) * words);
+	ckpt_io(ck, sim->modbits, sizeof(unsigned long) * words);
+	ckpt_io(ck, sim->freebits, sizeof(unsigned long) * words);
+	if(sim->freeList) ckpt_io(ck, sim->freeList, sizeof(int) * frames);
+	ckpt_io(ck, sim->numa, sizeof(struct numa_node) * NUMA_NODES);
+	if(sim->ages) ckpt_io(ck, sim->ages, sizeof(unsigned int) * frames);
+	if(sim->lastUse) ckpt_io(ck, sim->lastUse, sizeof(unsigned long) * frames);
+	if(sim->optHeap) {
+		ckpt_io(ck, sim->optHeap, sizeof(int) * frames);
+		ckpt_io(ck, sim->optHeapPos, sizeof(int) * frames);
+		ckpt_io(ck, sim->optKey, sizeof(size_t) * frames);
+	}
+	if(sim->hist) {
+		ckpt_io(ck, sim->frameEntry, sizeof(int) * frames);
+		ckpt_history(ck, sim->hist, 2 * frames + 2); // capacity from createSim
+	}
+	if(sim->tlb) ckpt_tlb(ck, sim->tlb);
+	if(sim->snapBase) ckpt_io(ck, sim->snapBase, sizeof(struct pstat_t) * sim->layout->procCount);
+	if(sim->objects) {
+		ckpt_pagemap(ck, sim->objects);
+		CKPT(sim->objCount);
+		CKPT(sim->objCap);
+		CKPT(sim->rmapCap);
+		CKPT(sim->rmapFree);
+		// both stay NULL until the first shared page is faulted in
+		if(ck->load && sim->objCap) {
+			sim->objPages = (struct objpage*) realloc(sim->objPages, sizeof(struct objpage) * sim->objCap);
+		}
+		if(ck->load && sim->rmapCap) {
+			sim->rmap = (struct rmap_t*) realloc(sim->rmap, sizeof(struct rmap_t) * sim->rmapCap);
+		}
+		if(sim->objCap) ckpt_io(ck, sim->objPages, sizeof(struct objpage) * sim->objCap);
+		if(sim->rmapCap) ckpt_io(ck, sim->rmap, sizeof(struct rmap_t) * sim->rmapCap);
+	}
 
-	struct list* l = (struct list*) malloc(sizeof(struct list));
-	l->tail = NULL;
-	l->head = NULL;
-	l->size = 0;
-	return l;
-}
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		struct process* proc = &sim->procArray[i];
+		CKPT(proc->vtime);
+		ckpt_io(ck, proc->pstat, sizeof(struct pstat_t));
+		if(proc->ra) ckpt_io(ck, proc->ra, sizeof(struct readahead) * (proc->vma_list->size + 1));
+		ckpt_page_table(ck, proc);
+	}
 
-void add(struct list* l, void* v) {
+	#undef CKPT
 
-	struct node* n = (struct node*) malloc(sizeof(struct node));
-	n->val = v;
-	n->next = NULL;
+	if(!ck->load) {
+		return;
+	}
 
-	if(l->size == 0) {
-		l->head = n;
-	} else {
-		l->tail->next = n;
+	for(int i = 0; i < frames; i++) {
+		struct frame_t* frame = &sim->frametable[i];
+		if(frame->pte) {
+			frame->pte = lookup_pte(&sim->procArray[frame->pid], frame->vpage, false);
+		}
+		for(int e = frame->pte ? frame->rmap : -1; e != -1; e = sim->rmap[e].next) {
+			sim->rmap[e].pte = lookup_pte(&sim->procArray[sim->rmap[e].pid], sim->rmap[e].vpage, false);
+		}
 	}
 
-	l->tail = n;
-	l->size++;
+	// huge entries cache no pte, base entries the one their key names
+	struct tlb* tlb = sim->tlb;
+	for(int i = 0; tlb && i < tlb->sets * tlb->ways; i++) {
+		unsigned long key = tlb->keys[i] - 1;
+		if(tlb->keys[i] && !(key >> TLB_HUGE_SHIFT)) {
+			tlb->ptes[i] = lookup_pte(&sim->procArray[key >> MAX_VPAGE_BITS], key & ((1UL << MAX_VPAGE_BITS) - 1), false);
+		}
+	}
 }
 
-// confirm the vpage from the instruction is a valid page in the vma of CURRENT_PROCESS
-struct vma_t* find_vma_list() {
+// fread or fwrite size bytes at p, depending on the direction of ck
+void ckpt_io(struct ckpt* ck, void* p, size_t size) {
 
-	struct node* h = CURRENT_PROCESS.vma_list->head;
-	struct vma_t* vma = NULL;
+	if(!ck->load) {
+		fwrite(p, 1, size, ck->fp);
+	} else if(fread(p, 1, size, ck->fp) != size) {
+		printf("Error: Truncated checkpoint\n");
+		exit(1);
+	}
+}
 
-	while(h != NULL) {
-		vma = (struct vma_t*) h->val;
-		if((vma->start_vpage <= curr_vpage) && (curr_vpage <= vma->end_vpage)) {
-			return vma;
-		} else {
-			h = h->next;
-		}
+void ckpt_history(struct ckpt* ck, struct history* h, int cap) {
+
+	ckpt_io(ck, h->keys, sizeof(unsigned long) * cap);
+	ckpt_io(ck, h->frames, sizeof(int) * cap);
+	ckpt_io(ck, h->prev, sizeof(int) * cap);
+	ckpt_io(ck, h->next, sizeof(int) * cap);
+	ckpt_io(ck, h->chain, sizeof(int) * cap);
+	ckpt_io(ck, h->lists, cap);
+	ckpt_io(ck, h->flags, cap);
+	ckpt_io(ck, h->buckets, sizeof(int) * (h->mask + 1));
+	ckpt_io(ck, &h->freeHead, sizeof(h->freeHead));
+	ckpt_io(ck, h->head, sizeof(h->head));
+	ckpt_io(ck, h->tail, sizeof(h->tail));
+	ckpt_io(ck, h->size, sizeof(h->size));
+}
+
+// everything but the ptes, see serializeSim
+void ckpt_tlb(struct ckpt* ck, struct tlb* tlb) {
+
+	int entries = tlb->sets * tlb->ways;
+	ckpt_io(ck, tlb->keys, sizeof(unsigned long) * entries);
+	ckpt_io(ck, tlb->stamps, sizeof(unsigned long) * entries);
+	ckpt_io(ck, &tlb->clock, sizeof(tlb->clock));
+	ckpt_io(ck, &tlb->seed, sizeof(tlb->seed));
+	ckpt_io(ck, &tlb->hits, sizeof(tlb->hits));
+	ckpt_io(ck, &tlb->misses, sizeof(tlb->misses));
+	ckpt_io(ck, &tlb->flushes, sizeof(tlb->flushes));
+	ckpt_io(ck, &tlb->shootdowns, sizeof(tlb->shootdowns));
+}
+
+void ckpt_pagemap(struct ckpt* ck, struct pagemap* map) {
+
+	ckpt_io(ck, &map->cap, sizeof(map->cap));
+	ckpt_io(ck, &map->count, sizeof(map->count));
+	if(ck->load) {
+		map->keys = (unsigned long*) realloc(map->keys, sizeof(unsigned long) * map->cap);
+		map->vals = (int*) realloc(map->vals, sizeof(int) * map->cap);
 	}
+	ckpt_io(ck, map->keys, sizeof(unsigned long) * map->cap);
+	ckpt_io(ck, map->vals, sizeof(int) * map->cap);
+}
 
-	return NULL;
+// the leaves of proc's page table as (leaf number, PT_FANOUT ptes) records, ended by ULONG_MAX
+void ckpt_page_table(struct ckpt* ck, struct process* proc) {
+
+	unsigned long leaf = ULONG_MAX;
+
+	if(!ck->load) {
+		ckpt_leaves(ck, proc->pagetable, proc->layout->ptLevels, 0);
+		ckpt_io(ck, &leaf, sizeof(leaf));
+		return;
+	}
+
+	for(ckpt_io(ck, &leaf, sizeof(leaf)); leaf != ULONG_MAX; ckpt_io(ck, &leaf, sizeof(leaf))) {
+		struct pte_t* ptes = lookup_pte(proc, leaf << PT_BITS, true);
+		if(!ptes) {
+			printf("Error: Corrupt checkpoint\n");
+			exit(1);
+		}
+		ckpt_io(ck, ptes, sizeof(struct pte_t) * PT_FANOUT);
+	}
 }
 
-// create circular list from frametable
-void initCircularClock() {
+// level counts down to 1 at the leaves, base is the leaf number of the node's first leaf
+void ckpt_leaves(struct ckpt* ck, void* node, int level, unsigned long base) {
 
-	struct list* l = createList();
+	if(!node) {
+		return;
+	}
 
-	for(int i = 0; i < NUM_FRAMES ; i++) {
-		add(l, (void*) &frametable[i]);
+	if(level > 1) {
+		for(unsigned long i = 0; i < PT_FANOUT; i++) {
+			ckpt_leaves(ck, ((void**) node)[i], level - 1, base * PT_FANOUT + i);
+		}
+		return;
 	}
 
-	CURR_CLOCK_HAND = l->head;
-	// circularizes list
-	l->tail->next = l->head;
-	clockList = l;
+	ckpt_io(ck, &base, sizeof(base));
+	ckpt_io(ck, node, sizeof(struct pte_t) * PT_FANOUT);
 }
 
 
 /*
-	Random value generator functions
+	Buffered output functions
 */
 
-int myrandom(int size) {
+struct outbuf* createOutbuf(int fd, bool owned) {
 
-	if(ofs == randCount) {
-		ofs = 0;
+	struct outbuf* ob = (struct outbuf*) malloc(sizeof(struct outbuf));
+	ob->fd = fd;
+	ob->owned = owned;
+	ob->cap = OUTBUF_SIZE;
+	ob->len = 0;
+	ob->buf = (char*) malloc(ob->cap);
+	if(!ob->buf) {
+		printf("Error: Out of memory for output buffer\n");
+		exit(1);
 	}
+	return ob;
+}
+
+void freeOutbuf(struct outbuf* ob) {
 
-	return (randVals[ofs++] % size); 
+	out_flush(ob);
+	if(ob->owned) {
+		close(ob->fd);
+	}
+	free(ob->buf);
+	free(ob);
 }
 
-void createRandArray(char* filename) {
+// one write per buffer full; stdio output to the same descriptor goes first so lines stay in order
+void out_flush(struct outbuf* ob) {
 
-	FILE* fp = fopen(filename,"r");
-	if(!fp) {
-		printf("Error: Could not open rfile\n");
-		exit(1);
+	if(ob->fd >= 0 && ob->len > 0) {
+		if(ob->fd == STDOUT_FILENO) {
+			fflush(stdout);
+		}
+		for(size_t done = 0; done < ob->len; ) {
+			ssize_t n = write(ob->fd, ob->buf + done, ob->len - done);
+			if(n < 0) {
+				printf("Error: Could not write output\n");
+				exit(1);
+			}
+			done += n;
+		}
 	}
+	ob->len = 0;
+}
 
-	char line[15];
-	int i = 0;
-	fgets(line, 15, fp);
-	randCount = atoi(line);
-	randVals = (int*) malloc(sizeof(int) * randCount); 
-	
-	while(fgets(line, 15, fp)) {
-		randVals[i] = atoi(line);
-		i++;
+void out_str(struct outbuf* ob, const char* str) {
+
+	size_t n = strlen(str);
+	if(ob->len + n > ob->cap) {
+		out_flush(ob);
 	}
+	memcpy(ob->buf + ob->len, str, n);
+	ob->len += n;
+}
 
-	fclose(fp);
+void out_byte(struct outbuf* ob, int c) {
+
+	if(ob->len == ob->cap) {
+		out_flush(ob);
+	}
+	ob->buf[ob->len++] = (char) c;
+}
+
+void out_ulong(struct outbuf* ob, unsigned long v) {
+
+	char digits[21];
+	int i = sizeof(digits) - 1;
+	digits[i] = '\0';
+	do {
+		digits[--i] = (char) ('0' + v % 10);
+		v /= 10;
+	} while(v);
+	out_str(ob, digits + i);
+}
+
+// unsigned LEB128, as put_varint writes to a FILE
+void out_varint(struct outbuf* ob, unsigned long v) {
+
+	if(ob->len + 10 > ob->cap) {
+		out_flush(ob);
+	}
+	while(v >= 0x80) {
+		ob->buf[ob->len++] = (char) ((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	ob->buf[ob->len++] = (char) v;
+}
+
+void out_printf(struct outbuf* ob, const char* fmt, ...) {
+
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(ob->buf + ob->len, ob->cap - ob->len, fmt, ap);
+	va_end(ap);
+
+	if(n >= 0 && ob->len + n < ob->cap) {
+		ob->len += n;
+		return;
+	}
+
+	out_flush(ob);
+	va_start(ap, fmt);
+	n = vsnprintf(ob->buf, ob->cap, fmt, ap);
+	va_end(ap);
+	if(n < 0 || (size_t) n >= ob->cap) {
+		printf("Error: Output line too long\n");
+		exit(1);
+	}
+	ob->len = n;
 }
 
 
@@ -714,53 +5911,251 @@ void createRandArray(char* filename) {
 	Printout functions
 */
 
-void printFrameTable() {
-	printf("FT: ");
-	for(int i = 0; i < NUM_FRAMES; i++) {
-		if(frametable[i].pid == UINT_MAX && frametable[i].vpage == UINT_MAX) {
-			printf("* ");
+void printFrameTable(struct sim* sim) {
+	out_printf(sim->out, "FT: ");
+	printFrames(sim);
+	out_printf(sim->out, "\n");
+}
+
+void printFrames(struct sim* sim) {
+	for(int i = 0; i < sim->num_frames; i++) {
+		if(sim->frametable[i].pid == UINT_MAX && sim->frametable[i].vpage == ULONG_MAX) {
+			out_printf(sim->out, "* ");
 		} else {
-			printf("%d:%d ", frametable[i].pid, frametable[i].vpage);
+			out_printf(sim->out, "%d:%lu ", sim->frametable[i].pid, sim->frametable[i].vpage);
 		}
 	}
-	printf("\n");
 }
 
-void printPageTables() {
+// a single-leaf address space prints every pte as before; larger ones print only pages that were ever mapped, as <vpage>:#
+void printPageTables(struct sim* sim) {
 
-	for(int i = 0; i < procCount; i++) {
-		struct pte_t* pagetable = procArray[i].pagetable;
-		printf("PT[%d]: ", i);
-		for(int i = 0; i < NUM_VPAGES; i++) {
-	
-			if(!pagetable[i].present) {
-				if(pagetable[i].pagedout) {
-					printf("# ");
-				} else {
-					printf("* ");
-				}		
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		printPageTable(sim, i);
+	}
+}
+
+void printPageTable(struct sim* sim, int pid) {
+
+	const struct layout* layout = sim->layout;
+	struct pte_t* pagetable = (layout->ptLevels == 1) ? (struct pte_t*) sim->procArray[pid].pagetable : NULL;
+	out_printf(sim->out, "PT[%d]: ", pid);
+
+	if(layout->ptLevels > 1) {
+		printPageTableLeaves(sim, sim->procArray[pid].pagetable, layout->ptLevels, 0);
+		out_printf(sim->out, "\n");
+		return;
+	}
+
+	for(unsigned long i = 0; i < layout->numVpages; i++) {
+
+		if(!pagetable || !pagetable[i].present) {
+			if(pagetable && pagetable[i].pagedout) {
+				out_printf(sim->out, "# ");
 			} else {
-				char r = (pagetable[i].referenced ? 'R' : '-');
-				char m = (pagetable[i].modified ? 'M' : '-');
-				char s = (pagetable[i].pagedout ? 'S' : '-');
-				printf("%d:%c%c%c ", i, r, m, s);
-			}
+				out_printf(sim->out, "* ");
+			}		
+		} else {
+			char r = (pagetable[i].referenced ? 'R' : '-');
+			char m = (pagetable[i].modified ? 'M' : '-');
+			char s = (pagetable[i].pagedout ? 'S' : '-');
+			out_printf(sim->out, "%lu:%c%c%c ", i, r, m, s);
+		}
+	}
+	out_printf(sim->out, "\n");
+}
+
+void printPageTableLeaves(struct sim* sim, void* node, int level, unsigned long base) {
+
+	if(!node) {
+		return;
+	}
+
+	if(level > 1) {
+		for(unsigned long i = 0; i < PT_FANOUT; i++) {
+			printPageTableLeaves(sim, ((void**) node)[i], level - 1, (base << PT_BITS) | i);
+		}
+		return;
+	}
+
+	struct pte_t* leaf = (struct pte_t*) node;
+	for(unsigned long i = 0; i < PT_FANOUT; i++) {
+		unsigned long vpage = (base << PT_BITS) | i;
+		if(leaf[i].present) {
+			out_printf(sim->out, "%lu:%c%c%c ", vpage, leaf[i].referenced ? 'R' : '-',
+				leaf[i].modified ? 'M' : '-', leaf[i].pagedout ? 'S' : '-');
+		} else if(leaf[i].pagedout) {
+			out_printf(sim->out, "%lu:# ", vpage);
 		}
-		printf("\n");	
 	}
 }
 
-void printStats() {
+void printStats(struct sim* sim) {
 
-	for(int i = 0; i < procCount; i++) {
-		struct process* proc = &procArray[i];
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		struct process* proc = &sim->procArray[i];
 		struct pstat_t* pstat = proc->pstat;
-		printf("PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
+		out_printf(sim->out, "PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
 		proc->pid, pstat->unmaps, pstat->maps, pstat->ins, pstat->outs, pstat->fins, 
 		pstat->fouts, pstat->zeros, pstat->segv, pstat->segprot);
-		cost += ((pstat->unmaps + pstat->maps) * 400) + ((pstat->ins + pstat->outs) * 3000) +
-		((pstat->fins + pstat->fouts) * 2500) + (pstat->zeros * 150) + (pstat->segv * 240) + (pstat->segprot * 300);
+		sim->cost += pstatCost(pstat);
+	}
+
+	if(sim->tlb) {
+		struct tlb* tlb = sim->tlb;
+		out_printf(sim->out, "TLB: H=%lu M=%lu FL=%lu SD=%lu\n", tlb->hits, tlb->misses, tlb->flushes, tlb->shootdowns);
+		sim->cost += tlbCost(sim);
+	}
+
+	if(sim->hist) {
+		struct history* h = sim->hist;
+		int ghosts = (sim->pager == 'P') ? sim->countTest : h->size[HIST_B1] + h->size[HIST_B2];
+		out_printf(sim->out, "GHOST: H=%lu N=%d T=%d\n", sim->ghostHits, ghosts, sim->target);
+	}
+
+	if(READAHEAD_MAX) {
+		out_printf(sim->out, "RA: P=%lu H=%lu W=%lu\n", sim->raPages, sim->raHits, sim->raWasted);
+		sim->cost += readaheadCost(sim);
+	}
+
+	if(KSWAPD_LOW) {
+		struct pstat_t* bg = &sim->kswapdStat;
+		out_printf(sim->out, "KSWAPD: W=%lu U=%lu O=%lu FO=%lu DR=%lu C=%lu\n", sim->kswapdWakeups,
+			bg->unmaps, bg->outs, bg->fouts, sim->directReclaims, pstatCost(bg));
+	}
+
+	if(sim->layout->sharing) {
+		out_printf(sim->out, "SHARE: S=%lu C=%lu R=%lu F=%lu\n", sim->shareMaps, sim->cowCopies, sim->cowReuses, sim->sharedPeak);
+		sim->cost += shareCost(sim);
+	}
+
+	if(NUMA_NODES > 1) {
+		out_printf(sim->out, "NUMA: L=%lu R=%lu F=%lu C=%lu\n", sim->localRefs, sim->remoteRefs, sim->fallbacks, numaCost(sim));
+		sim->cost += numaCost(sim);
+	}
+
+	if(sim->layout->hugeEnabled) {
+		out_printf(sim->out, "HUGE: F=%lu HM=%lu SPL=%lu COL=%lu\n", sim->faults, sim->hugeMaps, sim->splits, sim->collapses);
+	}
+
+	out_printf(sim->out, "TOTALCOST %lu %lu %lu\n", sim->ctxSwitches, sim->instCount, sim->cost);
+}
+
+/*
+	Summary of a -L run: each process's PROC line from its own sim, the
+	optional lines summed over the sims, and "QUOTA[pid]: F=<frames at the
+	end> MIN=<fewest> MAX=<most>" per process.
+*/
+void printLocalStats(struct sim** sims, int count, const int* minQuotas, const int* maxQuotas) {
+
+	struct outbuf* out = sims[0]->out;
+	unsigned long ctxSwitches = 0, instCount = 0, cost = 0;
+	unsigned long tlbHits = 0, tlbMisses = 0, ghostHits = 0, ghosts = 0, target = 0;
+	unsigned long raPages = 0, raHits = 0, raWasted = 0, faults = 0, hugeMaps = 0, splits = 0, collapses = 0;
+
+	for(int i = 0; i < count; i++) {
+		struct sim* sim = sims[i];
+		struct pstat_t* pstat = sim->procArray[i].pstat;
+		out_printf(out, "PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
+		i, pstat->unmaps, pstat->maps, pstat->ins, pstat->outs, pstat->fins,
+		pstat->fouts, pstat->zeros, pstat->segv, pstat->segprot);
+
+		ctxSwitches += sim->ctxSwitches;
+		instCount += sim->instCount;
+		cost += sim->cost + pstatCost(pstat) + tlbCost(sim) + readaheadCost(sim);
+		if(sim->tlb) {
+			tlbHits += sim->tlb->hits;
+			tlbMisses += sim->tlb->misses;
+		}
+		if(sim->hist) {
+			ghostHits += sim->ghostHits;
+			ghosts += (sim->pager == 'P') ? sim->countTest : sim->hist->size[HIST_B1] + sim->hist->size[HIST_B2];
+			target += sim->target;
+		}
+		raPages += sim->raPages;
+		raHits += sim->raHits;
+		raWasted += sim->raWasted;
+		faults += sim->faults;
+		hugeMaps += sim->hugeMaps;
+		splits += sim->splits;
+		collapses += sim->collapses;
+	}
+
+	// each process has a TLB to itself, so nothing is flushed or shot down across processes
+	if(TLB_ENTRIES) {
+		unsigned long shootdowns = 0;
+		for(int i = 0; i < count; i++) {
+			shootdowns += sims[i]->tlb->shootdowns;
+		}
+		out_printf(out, "TLB: H=%lu M=%lu FL=0 SD=%lu\n", tlbHits, tlbMisses, shootdowns);
+	}
+	if(sims[0]->hist) {
+		out_printf(out, "GHOST: H=%lu N=%lu T=%lu\n", ghostHits, ghosts, target);
+	}
+	if(READAHEAD_MAX) {
+		out_printf(out, "RA: P=%lu H=%lu W=%lu\n", raPages, raHits, raWasted);
+	}
+	if(sims[0]->layout->hugeEnabled) {
+		out_printf(out, "HUGE: F=%lu HM=%lu SPL=%lu COL=%lu\n", faults, hugeMaps, splits, collapses);
+	}
+	for(int i = 0; i < count; i++) {
+		out_printf(out, "QUOTA[%d]: F=%d MIN=%d MAX=%d\n", i, sims[i]->frameLimit, minQuotas[i], maxQuotas[i]);
+	}
+
+	out_printf(out, "TOTALCOST %lu %lu %lu\n", ctxSwitches, instCount, cost);
+}
+
+/*
+	-i N: every N instructions each process gets a line of what changed
+	since the last snapshot, "SNAP <inst> <pid> <maps> <ins> <outs> <fins>
+	<fouts> <zeros> <cost> <rate>", cost being the interval's map and I/O
+	cost and rate that per instruction. The lines are flushed as they are
+	written, so they can be followed while the run goes on.
+*/
+void printSnapshot(struct sim* sim) {
+
+	for(int i = 0; i < sim->layout->procCount; i++) {
+		struct pstat_t* now = sim->procArray[i].pstat;
+		struct pstat_t* base = &sim->snapBase[i];
+		struct pstat_t delta = { now->unmaps - base->unmaps, now->maps - base->maps, now->ins - base->ins,
+			now->outs - base->outs, now->fins - base->fins, now->fouts - base->fouts, now->zeros - base->zeros,
+			now->segv - base->segv, now->segprot - base->segprot };
+		unsigned long cost = pstatCost(&delta);
+
+		out_printf(sim->out, "SNAP %lu %d %lu %lu %lu %lu %lu %lu %lu %.3f\n", sim->instCount, i, delta.maps,
+			delta.ins, delta.outs, delta.fins, delta.fouts, delta.zeros, cost, (double) cost / SNAP_INTERVAL);
+		*base = *now;
 	}
 
-	printf("TOTALCOST %lu %lu %lu\n", ctxSwitches, instCount, cost);
+	sim->nextSnap += SNAP_INTERVAL;
+	out_flush(sim->out);
+}
+
+unsigned long tlbCost(struct sim* sim) {
+
+	return sim->tlb ? sim->tlb->misses * TLB_MISS_COST : 0;
+}
+
+// a map for each prefetched page plus its share of the batched read
+unsigned long readaheadCost(struct sim* sim) {
+
+	return sim->raPages * (400 + READAHEAD_IO_COST);
+}
+
+// the copies of COW faults; their maps are in the pstats
+unsigned long shareCost(struct sim* sim) {
+
+	return sim->cowCopies * COW_COPY_COST;
+}
+
+// the extra latency of references to another node's memory
+unsigned long numaCost(struct sim* sim) {
+
+	return sim->remoteRefs * NUMA_REMOTE_COST;
+}
+
+unsigned long pstatCost(struct pstat_t* pstat) {
+
+	return ((pstat->unmaps + pstat->maps) * 400) + ((pstat->ins + pstat->outs) * 3000) +
+	((pstat->fins + pstat->fouts) * 2500) + (pstat->zeros * 150) + (pstat->segv * 240) + (pstat->segprot * 300);
 }
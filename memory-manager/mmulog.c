@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mmutrace.h"
+
+/*
+	Decodes an event log written by mmu -l back into the text mmu -oO
+	prints, see mmutrace.h.
+
+	usage: mmulog <logfile|->
+*/
+
+static char outbuf[1 << 20];
+
+unsigned long get_varint(FILE* fp);
+int get_byte(FILE* fp);
+
+
+int main(int argc, char* argv[]) {
+
+	if(argc != 2) {
+		fprintf(stderr, "usage: %s <logfile|->\n", argv[0]);
+		return 1;
+	}
+
+	FILE* in = strcmp(argv[1], "-") ? fopen(argv[1], "rb") : stdin;
+	if(!in) {
+		printf("Error: Could not open event log\n");
+		exit(1);
+	}
+
+	char magic[LOG_MAGIC_LEN];
+	if(fread(magic, 1, LOG_MAGIC_LEN, in) != LOG_MAGIC_LEN || memcmp(magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) {
+		printf("Error: Not an mmu event log\n");
+		exit(1);
+	}
+	setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+	unsigned long inst = 0;
+	while(true) {
+		int b = get_byte(in);
+		int opcode = b >> OP_SHIFT;
+		int code = b & OPERAND_MASK;
+
+		if(opcode != OP_ESCAPE) {
+			printf("%lu: ==> %c %d\n", inst++, TRACE_OPS[opcode], code);
+		} else if(code == ESC_END) {
+			break;
+		} else if(code < OP_ESCAPE) {
+			printf("%lu: ==> %c %lu\n", inst++, TRACE_OPS[code], get_varint(in));
+		} else if(code >= EV_BASE && code < EV_BASE + EV_COUNT) {
+			int ev = code - EV_BASE;
+			if(EVENT_ARGS[ev] == 0) {
+				printf("  %s\n", EVENT_NAMES[ev]);
+			} else if(EVENT_ARGS[ev] == 1) {
+				printf("  %s %lu\n", EVENT_NAMES[ev], get_varint(in));
+			} else {
+				unsigned long a = get_varint(in);
+				printf("  %s %lu:%lu\n", EVENT_NAMES[ev], a, get_varint(in));
+			}
+		} else {
+			printf("Error: Bad event record after instruction %lu\n", inst);
+			exit(1);
+		}
+	}
+
+	if(in != stdin) fclose(in);
+	return 0;
+}
+
+
+int get_byte(FILE* fp) {
+
+	int b = getc(fp);
+	if(b == EOF) {
+		printf("Error: Truncated event log\n");
+		exit(1);
+	}
+	return b;
+}
+
+unsigned long get_varint(FILE* fp) {
+
+	unsigned long v = 0;
+	int shift = 0, b;
+	do {
+		b = get_byte(fp);
+		v |= (unsigned long) (b & 0x7f) << shift;
+		shift += 7;
+	} while(b & 0x80);
+	return v;
+}
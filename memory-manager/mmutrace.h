@@ -0,0 +1,109 @@
+#ifndef MMUTRACE_H
+#define MMUTRACE_H
+
+#include <stdio.h>
+
+/*
+	Packed binary trace format read by mmu and written by trace2bin.
+
+	header:	TRACE_MAGIC
+		varint procCount
+		per process: varint vmaCount, then per vma
+			varint start_vpage, varint end_vpage, varint flags (VMA_*),
+			then varint object id if VMA_SHARED or VMA_COW is set
+
+	ops:	one byte per op: top 2 bits opcode, low 6 bits operand (vpage, or pid for 'c').
+		Operands that do not fit in 6 bits use an OP_ESCAPE byte whose low 6 bits
+		hold the real opcode, followed by the operand as a varint. An OP_ESCAPE
+		byte carrying ESC_END terminates the trace.
+
+	varints are unsigned LEB128.
+*/
+
+#define TRACE_MAGIC "\x89MMUTRC\n"
+#define TRACE_MAGIC_LEN 8
+
+#define OP_READ 0
+#define OP_WRITE 1
+#define OP_CTX 2
+#define OP_ESCAPE 3
+#define OP_SHIFT 6
+#define OPERAND_MASK 0x3f
+#define ESC_END 0x3f
+
+#define VMA_WRITE_PROTECT 0x1
+#define VMA_FILEMAPPED 0x2
+#define VMA_HUGE_SHIFT 2 // huge page size class, 0 none, 1 2MB, 2 1GB
+#define VMA_HUGE_MASK 0xc
+#define VMA_SHARED 0x10
+#define VMA_COW 0x20
+
+static const char TRACE_OPS[] = "rwc";
+
+/*
+	Event log written by mmu -l and decoded by mmulog.
+
+	header:	LOG_MAGIC
+	records: every instruction as a trace op, in the format above, each
+		followed by the events it caused: an OP_ESCAPE byte whose low 6 bits
+		hold EV_BASE + the event code, then EVENT_ARGS varint operands.
+		ESC_END terminates the log.
+
+	Decoded, a record prints as the matching line of mmu -oO: instructions
+	as "<n>: ==> <op> <operand>" numbered from 0, events as "  <name>",
+	"  <name> <a>" or "  <name> <a>:<b>".
+*/
+
+#define LOG_MAGIC "\x89MMULOG\n"
+#define LOG_MAGIC_LEN 8
+#define EV_BASE 8
+
+#define EV_SEGV 0
+#define EV_SEGPROT 1
+#define EV_UNMAP 2
+#define EV_OUT 3
+#define EV_FOUT 4
+#define EV_IN 5
+#define EV_FIN 6
+#define EV_ZERO 7
+#define EV_MAP 8
+#define EV_HUGE 9
+#define EV_SPLIT 10
+#define EV_COLLAPSE 11
+#define EV_KSWAPD 12
+#define EV_READAHEAD 13
+#define EV_SHARE 14
+#define EV_COW 15
+#define EV_COUNT 16
+
+static const char* const EVENT_NAMES[EV_COUNT] = {
+	"SEGV", "SEGPROT", "UNMAP", "OUT", "FOUT", "IN", "FIN", "ZERO", "MAP", "HUGE", "SPLIT", "COLLAPSE",
+	"KSWAPD", "RA", "SHARE", "COW"
+};
+static const int EVENT_ARGS[EV_COUNT] = { 0, 0, 2, 0, 0, 0, 0, 0, 1, 2, 2, 2, 1, 2, 1, 1 };
+
+static inline void put_varint(FILE* fp, unsigned long v) {
+
+	while(v >= 0x80) {
+		putc((int) ((v & 0x7f) | 0x80), fp);
+		v >>= 7;
+	}
+	putc((int) v, fp);
+}
+
+static inline void put_op(FILE* fp, int opcode, unsigned long operand) {
+
+	if(operand <= OPERAND_MASK) {
+		putc((opcode << OP_SHIFT) | (int) operand, fp);
+	} else {
+		putc((OP_ESCAPE << OP_SHIFT) | opcode, fp);
+		put_varint(fp, operand);
+	}
+}
+
+static inline void put_end(FILE* fp) {
+
+	putc((OP_ESCAPE << OP_SHIFT) | ESC_END, fp);
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "mmutrace.h"
+
+/*
+	Converts a text mmu input file (process/vma header followed by "c/r/w <n>"
+	lines) into the packed binary format described in mmutrace.h.
+
+	usage: trace2bin <infile|-> <outfile|->
+*/
+
+static const char delims[] = " \t\r\n";
+
+bool next_line(FILE* fp, char* line, int size);
+void convertHeader(FILE* in, FILE* out);
+void convertInstructions(FILE* in, FILE* out);
+
+
+int main(int argc, char* argv[]) {
+
+	if(argc != 3) {
+		fprintf(stderr, "usage: %s <infile|-> <outfile|->\n", argv[0]);
+		return 1;
+	}
+
+	FILE* in = strcmp(argv[1], "-") ? fopen(argv[1], "r") : stdin;
+	if(!in) {
+		printf("Error: Could not open input file\n");
+		exit(1);
+	}
+
+	FILE* out = strcmp(argv[2], "-") ? fopen(argv[2], "wb") : stdout;
+	if(!out) {
+		printf("Error: Could not open output file\n");
+		exit(1);
+	}
+
+	fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, out);
+	convertHeader(in, out);
+	convertInstructions(in, out);
+	put_end(out);
+
+	if(in != stdin) fclose(in);
+	if(fclose(out) != 0) {
+		printf("Error: Could not write output file\n");
+		exit(1);
+	}
+
+	return 0;
+}
+
+
+bool next_line(FILE* fp, char* line, int size) {
+
+	if(!fgets(line, size, fp)) {
+		printf("Error: Truncated input header\n");
+		exit(1);
+	}
+	return true;
+}
+
+// same layout createProcArray() expects: 3 comment lines, count, then per process 2 comment lines and a vma count
+void convertHeader(FILE* in, FILE* out) {
+
+	char line[100];
+	next_line(in, line, 100); next_line(in, line, 100); next_line(in, line, 100); next_line(in, line, 100);
+	int procCount = atoi(strtok(line, delims));
+	put_varint(out, procCount);
+
+	for(int i = 0; i < procCount; i++) {
+
+		next_line(in, line, 100); next_line(in, line, 100); next_line(in, line, 100);
+		int vmaCount = atoi(strtok(line, delims));
+		put_varint(out, vmaCount);
+
+		for(int j = 0; j < vmaCount; j++) {
+
+			next_line(in, line, 100);
+			unsigned long start = strtoul(strtok(line, delims), NULL, 10);
+			unsigned long end = strtoul(strtok(NULL, delims), NULL, 10);
+			unsigned long flags = atoi(strtok(NULL, delims)) ? VMA_WRITE_PROTECT : 0;
+			flags |= atoi(strtok(NULL, delims)) ? VMA_FILEMAPPED : 0;
+			char* huge = strtok(NULL, delims);
+			flags |= huge ? ((unsigned long) atoi(huge) << VMA_HUGE_SHIFT) & VMA_HUGE_MASK : 0;
+			char* share = strtok(NULL, delims); // s<id> or c<id>, see mmu's parseShare
+			if(share && (share[0] == 's' || share[0] == 'c')) {
+				flags |= (share[0] == 's') ? VMA_SHARED : VMA_COW;
+			}
+			put_varint(out, start);
+			put_varint(out, end);
+			put_varint(out, flags);
+			if(flags & (VMA_SHARED | VMA_COW)) {
+				put_varint(out, strtoul(share + 1, NULL, 10));
+			}
+		}
+	}
+
+	next_line(in, line, 100);
+}
+
+void convertInstructions(FILE* in, FILE* out) {
+
+	char line[100];
+	unsigned long inst = 0;
+
+	while(fgets(line, 100, in)) {
+
+		char* op = strtok(line, delims);
+		if(!op) {
+			continue;
+		}
+		if(op[0] == '#') {
+			break;
+		}
+
+		const char* code = strchr(TRACE_OPS, op[0]);
+		char* arg = strtok(NULL, delims);
+		if(!code || op[1] != '\0' || !arg) {
+			printf("Error: Bad instruction %lu\n", inst);
+			exit(1);
+		}
+
+		put_op(out, (int) (code - TRACE_OPS), strtoul(arg, NULL, 10));
+		inst++;
+	}
+}